@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <getopt.h>
 #include <time.h>
@@ -36,15 +37,373 @@
 #include <poll.h>
 #include <pthread.h>
 #include <sched.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/futex.h>
 #include <alsa/asoundlib.h>
 
+/* io_uring via raw syscalls, multishot poll needs 5.13 kernel headers */
+#ifdef __NR_io_uring_setup
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#ifdef IORING_POLL_ADD_MULTI
+#define HAVE_IO_URING
+#endif
+#ifndef IORING_SETUP_COOP_TASKRUN
+#define IORING_SETUP_COOP_TASKRUN (1U << 8)
+#endif
+#ifndef IORING_FEAT_RSRC_TAGS
+#define IORING_FEAT_RSRC_TAGS (1U << 10) /* 5.13 */
+#endif
+#endif
+
 #ifdef __aarch64__
 #define SOUNDCARD_LABEL "DUOX"
 #else
 #define SOUNDCARD_LABEL "MODDUO"
 #endif
 
-typedef struct  {
+#define MAX_WORKERS 64
+#define WORKER_SPIN 2000
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause ()
+#elif defined(__aarch64__) || defined(__arm__)
+#define cpu_relax() __asm__ __volatile__ ("yield" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__ ("" ::: "memory")
+#endif
+
+/* startup phase durations [ns] */
+typedef struct {
+	uint64_t open;
+	uint64_t hwpar;
+	uint64_t swpar;
+	uint64_t link;
+	uint64_t prefill;
+	uint64_t start;
+	uint64_t thread;
+	uint64_t first_period;
+	uint64_t close;
+} StartupTiming;
+
+typedef struct {
+	size_t count;
+	double min;
+	double max;
+	double sum;
+	double sumsq;
+} RunningStat;
+
+/* log-linear histogram of durations [ns], 32 sub-buckets per octave
+ * (<= 3% relative error), constant size for any run-time */
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_OCTAVES  36
+#define HIST_BINS     (HIST_SUB + HIST_OCTAVES * HIST_SUB)
+
+typedef struct {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t sum;
+	uint64_t bins[HIST_BINS];
+} Histogram;
+
+typedef struct {
+	uint64_t  t_start;
+	uint64_t  t_end;
+	uint64_t  periods;
+	uint64_t  xruns;
+	Histogram wake; /* wakeup interval */
+	Histogram late; /* wakeup lateness, time the first period was ready */
+	Histogram proc; /* processing time, wakeup to commit */
+	Histogram recover; /* x-run recovery time */
+} RunStats;
+
+/* binary per-cycle trace, one fixed size record per process cycle */
+#define TRACE_MAGIC   "MODTRACE"
+#define TRACE_VERSION 1
+#define TRACE_RING    65536 /* records, power of two */
+
+#define TRACE_XRUN    0x01
+#define TRACE_TIMEOUT 0x02
+#define TRACE_POLLERR 0x04
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t samplerate;
+	uint32_t period;
+	uint32_t play_periods;
+	uint32_t capt_periods;
+	uint32_t play_nchan;
+	uint32_t capt_nchan;
+} TraceHeader;
+
+typedef struct {
+	uint64_t t_wake;     /* CLOCK_MONOTONIC [ns] */
+	uint32_t proc;       /* wakeup to commit [ns] */
+	uint32_t seq;
+	int32_t  play_avail;
+	int32_t  capt_avail;
+	int32_t  play_delay;
+	int32_t  capt_delay;
+	uint32_t play_hwptr; /* derived from committed frames and avail */
+	uint32_t capt_hwptr;
+	uint32_t periods;    /* periods processed in this cycle */
+	uint32_t flags;
+} TraceRecord;
+
+typedef struct {
+	TraceRecord* buf;
+	uint32_t     head; /* written by the process thread */
+	uint32_t     tail; /* written by the flush thread */
+	uint32_t     seq;
+	uint64_t     dropped;
+	uint64_t     written;
+	FILE*        f;
+	pthread_t    thread;
+	bool         quit;
+	bool         direct;   /* written via io_uring, no flush thread */
+	uint64_t     file_off;
+} TraceRing;
+
+enum Engine {
+	ENGINE_PPOLL = 0,
+	ENGINE_URING
+};
+
+/* io_uring wait engine state, owned by the process thread */
+typedef struct {
+	int                   fd;
+	bool                  failed; /* poll requests are rejected, stop the run */
+#ifdef HAVE_IO_URING
+	void*                 ring; /* SQ and CQ ring, single mmap */
+	size_t                ring_sz;
+	struct io_uring_sqe*  sqes;
+	size_t                sqes_sz;
+	struct io_uring_cqe*  cqes;
+	uint32_t              sq_entries;
+	uint32_t*             sq_head;
+	uint32_t*             sq_tail;
+	uint32_t*             sq_mask;
+	uint32_t*             sq_array;
+	uint32_t*             cq_head;
+	uint32_t*             cq_tail;
+	uint32_t*             cq_mask;
+	unsigned int          to_submit;
+	struct pollfd         pfd[16];
+	int                   n_pfd;
+	int                   n_play;
+	uint32_t              write_n; /* trace records in flight */
+	uint64_t              cqes_reaped;
+#endif
+} Uring;
+
+/* ftrace trace_marker annotations, preformatted */
+enum TraceMark {
+	MARK_WAKEUP = 0,
+	MARK_PERIOD_START,
+	MARK_PERIOD_END,
+	MARK_XRUN,
+	MARK_RECOVER_START,
+	MARK_RECOVER_END,
+	MARK_TIMEOUT,
+	MARK_STALL,
+	N_MARKS
+};
+
+#define MARK_STR(s) { "mod-alsa-test: " s "\n", sizeof ("mod-alsa-test: " s "\n") - 1 }
+
+static const struct {
+	const char* str;
+	size_t      len;
+} trace_marks[N_MARKS] = {
+	MARK_STR ("wakeup"),
+	MARK_STR ("period start"),
+	MARK_STR ("period end"),
+	MARK_STR ("xrun"),
+	MARK_STR ("recover start"),
+	MARK_STR ("recover end"),
+	MARK_STR ("poll timeout"),
+	MARK_STR ("watchdog stall"),
+};
+
+/* hardware pointer analysis, per stream */
+typedef struct {
+	bool        valid;
+	int64_t     pos_prev;   /* hw position [frames] */
+	uint64_t    ts_prev;    /* time of the last pointer update [ns] */
+	uint64_t    wakeups;
+	uint64_t    idle;       /* wakeups without pointer movement */
+	uint64_t    granule;    /* gcd of all pointer steps */
+	uint64_t    multiple;   /* steps that are a multiple of the period */
+	RunningStat step;       /* pointer step [frames] */
+	RunningStat irq;        /* interval between pointer updates [us] */
+	RunningStat lag;        /* wakeup - pointer timestamp [us] */
+	/* online linear regression of position over time */
+	uint64_t    n;
+	uint64_t    t0;
+	int64_t     p0;
+	double      mean_t, mean_p;
+	double      m2_t, m2_p, cov;
+} HwPtrStats;
+
+#define MAX_STREAMS 16
+
+/* background load, each kind runs alone in its own test phase */
+enum StressKind {
+	STRESS_MEMBW = 0,
+	STRESS_CACHE,
+	STRESS_SYSCALL,
+	STRESS_CPU,
+	N_STRESS
+};
+
+static const char* stress_names[N_STRESS] = {
+	"membw",
+	"cache",
+	"syscall",
+	"cpu",
+};
+
+#define STRESS_MEM   (32 << 20) /* max. bytes per memory stressor thread */
+#define STRESS_CHUNK (256 << 10)
+#define STRESS_SLICE 10000000   /* duty-cycle period [ns] */
+
+struct _StressCtl;
+
+typedef struct {
+	struct _StressCtl* ctl;
+	pthread_t          thread;
+	enum StressKind    kind;
+	unsigned int       phase; /* test phase in which this thread is active */
+	int                cpu;
+	char*              mem;
+	uint64_t           ops;
+	uint64_t           busy;
+} Stressor;
+
+typedef struct _StressCtl {
+	const unsigned int* phase;
+	int                 level; /* duty cycle 1..100 % */
+	bool                quit;
+	enum StressKind     kinds[N_STRESS];
+	unsigned int        n_kinds;
+	int                 cpus[CPU_SETSIZE];
+	unsigned int        n_cpus;
+	Stressor*           threads;
+	unsigned int        n_threads;
+	unsigned int        n_joined;
+	size_t              mem_size; /* per memory stressor, 4x LLC, at most STRESS_MEM */
+	char                tmpdir[64];
+} StressCtl;
+
+struct _AlsaIO;
+
+/* process thread stall detection */
+typedef struct {
+	struct _AlsaIO** ios;
+	unsigned int     n_io;
+	unsigned int     threshold; /* periods without heartbeat */
+	pthread_t        thread;
+	bool             running;
+	bool             quit;
+	uint64_t         stalls;
+	uint64_t         max_stall; /* [ns] */
+	RunningStat      stall;     /* [ms] */
+	char             proc_status[MAX_STREAMS][2][64]; /* /proc/asound status, "" if unknown */
+	int              status_busy[MAX_STREAMS];
+} Watchdog;
+
+/* one device in the multi-stream event loop */
+typedef struct {
+	struct _AlsaIO* io;
+	bool            need_play;
+	bool            need_capt;
+	int             pfd_play; /* offset in the shared pollfd array */
+	int             pfd_capt;
+} MultiStream;
+
+typedef struct {
+	MultiStream   streams[MAX_STREAMS];
+	unsigned int  n_streams;
+	struct pollfd pfd[MAX_STREAMS * 16];
+	float         run_for;
+	uint64_t      t_start;
+	uint64_t      t_end;
+	uint64_t      wakeups;
+	uint64_t      busy;    /* time spent servicing streams [ns] */
+	Histogram     service; /* per wakeup */
+	RunningStat   ready;   /* streams serviced per wakeup */
+} MultiIO;
+
+/* per channel processing state */
+typedef struct {
+	float  z1, z2;
+	float  peak;
+	float  sink;
+	double phase; /* test signal */
+} __attribute__ ((aligned (64))) ChanState; /* no false sharing between workers */
+
+/* dither, applied when converting to 16 or 24 bit formats */
+enum DitherMode {
+	DITHER_NONE = 0,
+	DITHER_TPDF,
+	DITHER_SHAPED
+};
+
+typedef float    v4sf __attribute__ ((vector_size (16)));
+typedef int32_t  v4si __attribute__ ((vector_size (16)));
+typedef uint32_t v4su __attribute__ ((vector_size (16)));
+
+/* four channels are dithered in parallel, one per lane */
+typedef struct {
+	v4su rng;        /* xorshift32 state */
+	v4sf e1, e2, e3; /* quantization error history */
+} DitherLanes;
+
+
+typedef struct {
+	struct _AlsaIO* io;
+	pthread_t       thread;
+	unsigned int    id;
+	uint64_t        busy;
+} __attribute__ ((aligned (64))) Worker;
+
+/* fork/join pool for per-period channel processing.
+ * The process thread publishes a new generation, helpers (and the
+ * process thread itself) grab channels from a shared counter until
+ * all are done. Helpers spin briefly before sleeping on a futex. */
+typedef struct {
+	unsigned int n_workers; /* helper threads, not counting the process thread */
+	unsigned int active;    /* helpers taking part in the current period */
+	Worker*      workers;
+	int          generation;
+	int          sleepers;
+	uint64_t     ticket;    /* generation << 32 | next job */
+	unsigned int n_jobs;    /* constant, one job per channel */
+	unsigned int pending;
+	bool         quit;
+} WorkerPool;
+
+/* per test-phase statistics, processing times in [usec] */
+typedef struct {
+	unsigned int threads;
+	RunningStat  work;
+	RunningStat  wall;
+	RunningStat  overhead;
+	RunStats     run;
+} PhaseStats;
+
+typedef struct _AlsaIO {
+	char               name[64];
+
 	/* settings */
 	unsigned int       samplerate;
 	snd_pcm_uframes_t  samples_per_period;
@@ -56,29 +415,268 @@ typedef struct  {
 	float              run_for;
 	bool               debug;
 
+	bool               process;
+	unsigned int       dsp_load;
+	unsigned int       n_threads;
+	bool               scaling;
+
 	float**            testbuffers;
+	float**            scratch;
+	ChanState*         chan;
+	unsigned int       n_bufs;
+
+	double             sine_freq;
+	float              sine_gain;
+	enum DitherMode    dither;
+	float              dither_scale;
+	DitherLanes*       dl;
+	unsigned int       n_dl;
+	int32_t*           dq; /* quantized output, one period per playback channel */
 
 	/* state */
 	snd_pcm_t* play_handle;
 	snd_pcm_t* capt_handle;
 	bool       synced;
 
-	char*             play_ptr [64];
-	const char*       capt_ptr [64];
+	char**            play_ptr;
+	const char**      capt_ptr;
 	snd_pcm_uframes_t capt_offset;
 	snd_pcm_uframes_t play_offset;
 	size_t            play_bytes_per_sample;
 	size_t            capt_bytes_per_sample;
+	snd_pcm_format_t  play_format;
+	snd_pcm_format_t  capt_format;
 
 	int play_step;
 	int capt_step;
 
 	int play_npfd;
 	int capt_npfd;
+
+	snd_pcm_sframes_t play_avail;
+	snd_pcm_sframes_t capt_avail;
+	uint64_t          play_appl; /* frames committed since start */
+	uint64_t          capt_appl;
+	uint32_t          cycle_flags;
+
+	/* startup instrumentation */
+	StartupTiming    startup;
+	volatile uint64_t t_first_period;
+	uint64_t         t_prev;
+	bool             first_period_only;
+
+	/* parallel processing */
+	WorkerPool       pool;
+	unsigned int     n_phases;
+	unsigned int     phase;
+	size_t           phase_periods;
+	PhaseStats*      phase_stats;
+
+	/* statistics, whole run and soak intervals */
+	RunStats         stats;
+	uint64_t         soak_interval;
+	RunStats         ival[2];
+	int              ival_cur;
+	bool             ival_ready;
+	bool             thread_done;
+
+	TraceRing*       trace;
+
+	/* hw pointer analysis, [0]: playback, [1]: capture */
+	bool             hwptr_stats;
+	HwPtrStats       hwp[2];
+
+	/* measured delay after each cycle [frames] */
+	bool             latency;
+	RunningStat      lat_play;
+	RunningStat      lat_capt;
+	RunningStat      lat_rtt;
+
+	/* ftrace */
+	int              marker_fd;
+	int              tracing_on_fd;
+	bool             tracing_stopped;
+
+	/* wait engine */
+	enum Engine      engine;
+	Uring*           uring;
+	uint64_t         wait_calls; /* ppoll or io_uring_enter */
+	uint64_t         ctxsw;      /* context switches of the process thread */
+
+	/* watchdog, heartbeat is bumped by the process thread every period */
+	uint64_t         heartbeat;
+	pid_t            rt_tid;
 } AlsaIO;
 
 static volatile bool signalled = false;
 
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void tmark (AlsaIO* io, enum TraceMark m)
+{
+	if (io->marker_fd >= 0 && write (io->marker_fd, trace_marks[m].str, trace_marks[m].len) < 0) {
+		/* tracing may be disabled, ignore */
+	}
+}
+
+static int tracefs_open (const char* file, int flags)
+{
+	char path[128];
+	int fd;
+	snprintf (path, sizeof (path), "/sys/kernel/tracing/%s", file);
+	if ((fd = open (path, flags | O_CLOEXEC)) >= 0) {
+		return fd;
+	}
+	snprintf (path, sizeof (path), "/sys/kernel/debug/tracing/%s", file);
+	return open (path, flags | O_CLOEXEC);
+}
+
+static int marker_open (AlsaIO* io, bool stop_on_xrun)
+{
+	if ((io->marker_fd = tracefs_open ("trace_marker", O_WRONLY)) < 0) {
+		fprintf (stderr, "cannot open ftrace trace_marker: %s\n", strerror (errno));
+		return -1;
+	}
+	if (stop_on_xrun && (io->tracing_on_fd = tracefs_open ("tracing_on", O_WRONLY)) < 0) {
+		fprintf (stderr, "cannot open ftrace tracing_on: %s\n", strerror (errno));
+		return -1;
+	}
+	return 0;
+}
+
+static void marker_close (AlsaIO* io)
+{
+	if (io->marker_fd >= 0) {
+		close (io->marker_fd);
+	}
+	if (io->tracing_on_fd >= 0) {
+		close (io->tracing_on_fd);
+	}
+	io->marker_fd = io->tracing_on_fd = -1;
+	if (io->tracing_stopped) {
+		fprintf (stdout, "ftrace: tracing was stopped at the first x-run.\n");
+	}
+}
+
+static void rs_reset (RunningStat* rs)
+{
+	memset (rs, 0, sizeof (RunningStat));
+}
+
+static void rs_add (RunningStat* rs, double v)
+{
+	if (rs->count == 0 || v < rs->min) {
+		rs->min = v;
+	}
+	if (rs->count == 0 || v > rs->max) {
+		rs->max = v;
+	}
+	rs->sum   += v;
+	rs->sumsq += v * v;
+	++rs->count;
+}
+
+static double rs_mean (const RunningStat* rs)
+{
+	return rs->count > 0 ? rs->sum / rs->count : 0;
+}
+
+static double rs_stddev (const RunningStat* rs)
+{
+	if (rs->count < 2) {
+		return 0;
+	}
+	const double mean = rs_mean (rs);
+	const double var  = (rs->sumsq - rs->count * mean * mean) / (rs->count - 1);
+	return var > 0 ? sqrt (var) : 0;
+}
+
+static void hist_reset (Histogram* h)
+{
+	memset (h, 0, sizeof (Histogram));
+}
+
+static inline unsigned int hist_index (uint64_t v)
+{
+	if (v < HIST_SUB) {
+		return v;
+	}
+	const int e = 63 - __builtin_clzll (v);
+	if (e >= HIST_SUB_BITS + HIST_OCTAVES) {
+		return HIST_BINS - 1;
+	}
+	return HIST_SUB + (e - HIST_SUB_BITS) * HIST_SUB + ((v >> (e - HIST_SUB_BITS)) - HIST_SUB);
+}
+
+/* upper bound of the values counted in bin `i` */
+static uint64_t hist_value (unsigned int i)
+{
+	if (i < HIST_SUB) {
+		return i;
+	}
+	const unsigned int e = (i - HIST_SUB) / HIST_SUB;
+	const uint64_t     m = (i - HIST_SUB) % HIST_SUB;
+	return ((HIST_SUB + m + 1) << e) - 1;
+}
+
+static inline void hist_add (Histogram* h, uint64_t v)
+{
+	if (h->count == 0 || v < h->min) {
+		h->min = v;
+	}
+	if (v > h->max) {
+		h->max = v;
+	}
+	h->sum += v;
+	++h->count;
+	++h->bins[hist_index (v)];
+}
+
+/* value below which `q` (0..1) of all samples are, [ns] */
+static uint64_t hist_percentile (const Histogram* h, double q)
+{
+	unsigned int i;
+	uint64_t acc = 0;
+	const uint64_t target = ceil (q * h->count);
+	if (h->count == 0) {
+		return 0;
+	}
+	for (i = 0; i < HIST_BINS; ++i) {
+		acc += h->bins[i];
+		if (acc >= target && acc > 0) {
+			const uint64_t v = hist_value (i);
+			return v > h->max ? h->max : v < h->min ? h->min : v;
+		}
+	}
+	return h->max;
+}
+
+static void stats_reset (RunStats* rs)
+{
+	rs->t_start = rs->t_end = 0;
+	rs->periods = rs->xruns = 0;
+	hist_reset (&rs->wake);
+	hist_reset (&rs->late);
+	hist_reset (&rs->proc);
+	hist_reset (&rs->recover);
+}
+
+static void print_hist (FILE* f, const char* name, const Histogram* h)
+{
+	fprintf (f, "%s min %.3f p50 %.3f p99 %.3f p99.9 %.3f max %.3f ms",
+			name,
+			h->min * 1e-6,
+			hist_percentile (h, .5) * 1e-6,
+			hist_percentile (h, .99) * 1e-6,
+			hist_percentile (h, .999) * 1e-6,
+			h->max * 1e-6);
+}
+
 void handle_sig (int sig) {
 	fprintf (stdout,"caught signal - shutting down.\n");
 	signalled = true;
@@ -122,6 +720,39 @@ static int realtime_pthread_create (
 }
 
 
+/* report requests outside of the device's configuration space */
+static int hw_check_range (snd_pcm_hw_params_t* hwpar, const AlsaIO* io, unsigned int ppc, const char* errname)
+{
+	unsigned int rate_min = 0, rate_max = 0;
+	unsigned int ppc_min = 0, ppc_max = 0;
+	snd_pcm_uframes_t spp_min = 0, spp_max = 0;
+	int rv = 0;
+
+	snd_pcm_hw_params_get_rate_min (hwpar, &rate_min, NULL);
+	snd_pcm_hw_params_get_rate_max (hwpar, &rate_max, NULL);
+	snd_pcm_hw_params_get_period_size_min (hwpar, &spp_min, NULL);
+	snd_pcm_hw_params_get_period_size_max (hwpar, &spp_max, NULL);
+	snd_pcm_hw_params_get_periods_min (hwpar, &ppc_min, NULL);
+	snd_pcm_hw_params_get_periods_max (hwpar, &ppc_max, NULL);
+
+	if (io->samplerate < rate_min || io->samplerate > rate_max) {
+		fprintf (stderr, "%s sample rate %u is outside of the device range %u..%u.\n",
+				errname, io->samplerate, rate_min, rate_max);
+		rv = -1;
+	}
+	if (io->samples_per_period < spp_min || io->samples_per_period > spp_max) {
+		fprintf (stderr, "%s period size %lu is outside of the device range %lu..%lu.\n",
+				errname, io->samples_per_period, spp_min, spp_max);
+		rv = -1;
+	}
+	if (ppc < ppc_min || ppc > ppc_max) {
+		fprintf (stderr, "%s periods %u is outside of the device range %u..%u.\n",
+				errname, ppc, ppc_min, ppc_max);
+		rv = -1;
+	}
+	return rv;
+}
+
 static int set_hwpar (AlsaIO* io, snd_pcm_hw_params_t *hwpar, bool play)
 {
 	bool err;
@@ -173,6 +804,9 @@ static int set_hwpar (AlsaIO* io, snd_pcm_hw_params_t *hwpar, bool play)
 		fprintf (stderr, "no supported sample format on %s interface.\n.", errname);
 		return -1;
 	}
+	if (hw_check_range (hwpar, io, ppc, errname)) {
+		return -1;
+	}
 	if (snd_pcm_hw_params_set_rate (handle, hwpar, io->samplerate, 0) < 0) {
 		fprintf (stderr, "cannot set %s sample rate to %u.\n", errname, io->samplerate);
 		return -1;
@@ -182,9 +816,9 @@ static int set_hwpar (AlsaIO* io, snd_pcm_hw_params_t *hwpar, bool play)
 	if (*nchan == 0) {
 		*nchan = max_chan;
 	}
-	if (*nchan > 64) {
-		fprintf (stderr, "detected more than 64 %s channnels, reset to 2.\n", errname);
-		*nchan = 2;
+	if (*nchan > max_chan) {
+		fprintf (stderr, "%s supports at most %u channels, requested %u.\n", errname, max_chan, *nchan);
+		return -1;
 	}
 	if (*nchan < 1) {
 		fprintf (stderr, "invalid %s channnel count %d\n", errname, *nchan);
@@ -236,6 +870,10 @@ static int set_swpar (AlsaIO* io, snd_pcm_sw_params_t* swpar, bool play)
 		fprintf (stderr, "cannot set %s timestamp mode to %u.\n", errname, SND_PCM_TSTAMP_MMAP);
 		return -1;
 	}
+	/* compare pointer timestamps with CLOCK_MONOTONIC wakeup times */
+	if (io->hwptr_stats && (err = snd_pcm_sw_params_set_tstamp_type (handle, swpar, SND_PCM_TSTAMP_TYPE_MONOTONIC)) < 0) {
+		fprintf (stderr, "cannot set %s timestamp type to monotonic.\n", errname);
+	}
 	if ((err = snd_pcm_sw_params_set_avail_min (handle, swpar, io->samples_per_period)) < 0) {
 		fprintf (stderr, "cannot set %s avail_min to %lu.\n", errname, io->samples_per_period);
 		return -1;
@@ -269,12 +907,14 @@ static float xrun_time (snd_pcm_status_t* stat)
 static int play_done (AlsaIO* io, int len)
 {
 	if (!io->play_handle) return 0;
+	io->play_appl += len;
 	return snd_pcm_mmap_commit (io->play_handle, io->play_offset, len);
 }
 
 static int capt_done (AlsaIO* io, int len)
 {
 	if (!io->capt_handle) return 0;
+	io->capt_appl += len;
 	return snd_pcm_mmap_commit (io->capt_handle, io->capt_offset, len);
 }
 
@@ -287,6 +927,302 @@ static void clear_chan (AlsaIO* io, char *dst, snd_pcm_uframes_t len)
 	}
 }
 
+static inline uint32_t bswap_if (uint32_t v, bool swap)
+{
+	return swap ? __builtin_bswap32 (v) : v;
+}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# define NATIVE_BE false
+#else
+# define NATIVE_BE true
+#endif
+
+/* convert a mmaped channel to float */
+static void read_chan (snd_pcm_format_t fmt, const char* src, int step, float* dst, snd_pcm_uframes_t len)
+{
+	snd_pcm_uframes_t i;
+	bool swap;
+	switch (fmt) {
+		case SND_PCM_FORMAT_FLOAT_LE:
+			for (i = 0; i < len; ++i, src += step) {
+				dst[i] = *((const float*) src);
+			}
+			break;
+		case SND_PCM_FORMAT_S32_LE:
+		case SND_PCM_FORMAT_S32_BE:
+			swap = (fmt == SND_PCM_FORMAT_S32_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, src += step) {
+				dst[i] = (int32_t) bswap_if (*((const uint32_t*) src), swap) / 2147483648.f;
+			}
+			break;
+		case SND_PCM_FORMAT_S24_LE:
+		case SND_PCM_FORMAT_S24_BE:
+			swap = (fmt == SND_PCM_FORMAT_S24_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, src += step) {
+				/* sign-extend the lower 24 bits */
+				dst[i] = ((int32_t) (bswap_if (*((const uint32_t*) src), swap) << 8) >> 8) / 8388608.f;
+			}
+			break;
+		case SND_PCM_FORMAT_S24_3LE:
+			for (i = 0; i < len; ++i, src += step) {
+				const unsigned char* b = (const unsigned char*) src;
+				dst[i] = ((int32_t) ((b[0] << 8) | (b[1] << 16) | ((uint32_t) b[2] << 24)) >> 8) / 8388608.f;
+			}
+			break;
+		case SND_PCM_FORMAT_S24_3BE:
+			for (i = 0; i < len; ++i, src += step) {
+				const unsigned char* b = (const unsigned char*) src;
+				dst[i] = ((int32_t) ((b[2] << 8) | (b[1] << 16) | ((uint32_t) b[0] << 24)) >> 8) / 8388608.f;
+			}
+			break;
+		case SND_PCM_FORMAT_S16_LE:
+		case SND_PCM_FORMAT_S16_BE:
+			swap = (fmt == SND_PCM_FORMAT_S16_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, src += step) {
+				const uint16_t v = *((const uint16_t*) src);
+				dst[i] = (int16_t) (swap ? __builtin_bswap16 (v) : v) / 32768.f;
+			}
+			break;
+		default:
+			memset (dst, 0, len * sizeof (float));
+			break;
+	}
+}
+
+static inline int32_t float_to_int (float v, float scale)
+{
+	v *= scale;
+	if (v >= scale - 1.f) {
+		return scale - 1.f;
+	}
+	if (v <= -scale) {
+		return -scale;
+	}
+	return lrintf (v);
+}
+
+/* convert float to the mmaped channel's format, clip, no dither */
+static void write_chan (snd_pcm_format_t fmt, char* dst, int step, const float* src, snd_pcm_uframes_t len)
+{
+	snd_pcm_uframes_t i;
+	bool swap;
+	switch (fmt) {
+		case SND_PCM_FORMAT_FLOAT_LE:
+			for (i = 0; i < len; ++i, dst += step) {
+				*((float*) dst) = src[i];
+			}
+			break;
+		case SND_PCM_FORMAT_S32_LE:
+		case SND_PCM_FORMAT_S32_BE:
+			swap = (fmt == SND_PCM_FORMAT_S32_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, dst += step) {
+				/* float has 24 bits of mantissa, full scale is 0x7fffff80 */
+				*((uint32_t*) dst) = bswap_if (float_to_int (src[i], 2147483520.f), swap);
+			}
+			break;
+		case SND_PCM_FORMAT_S24_LE:
+		case SND_PCM_FORMAT_S24_BE:
+			swap = (fmt == SND_PCM_FORMAT_S24_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, dst += step) {
+				*((uint32_t*) dst) = bswap_if (float_to_int (src[i], 8388608.f) & 0x00ffffff, swap);
+			}
+			break;
+		case SND_PCM_FORMAT_S24_3LE:
+			for (i = 0; i < len; ++i, dst += step) {
+				const int32_t v = float_to_int (src[i], 8388608.f);
+				unsigned char* b = (unsigned char*) dst;
+				b[0] = v; b[1] = v >> 8; b[2] = v >> 16;
+			}
+			break;
+		case SND_PCM_FORMAT_S24_3BE:
+			for (i = 0; i < len; ++i, dst += step) {
+				const int32_t v = float_to_int (src[i], 8388608.f);
+				unsigned char* b = (unsigned char*) dst;
+				b[2] = v; b[1] = v >> 8; b[0] = v >> 16;
+			}
+			break;
+		case SND_PCM_FORMAT_S16_LE:
+		case SND_PCM_FORMAT_S16_BE:
+			swap = (fmt == SND_PCM_FORMAT_S16_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, dst += step) {
+				const uint16_t v = float_to_int (src[i], 32768.f);
+				*((uint16_t*) dst) = swap ? __builtin_bswap16 (v) : v;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* pack integer samples into a 16 or 24 bit mmaped channel */
+static void write_chan_int (snd_pcm_format_t fmt, char* dst, int step, const int32_t* src, snd_pcm_uframes_t len)
+{
+	snd_pcm_uframes_t i;
+	bool swap;
+	switch (fmt) {
+		case SND_PCM_FORMAT_S24_LE:
+		case SND_PCM_FORMAT_S24_BE:
+			swap = (fmt == SND_PCM_FORMAT_S24_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, dst += step) {
+				*((uint32_t*) dst) = bswap_if (src[i] & 0x00ffffff, swap);
+			}
+			break;
+		case SND_PCM_FORMAT_S24_3LE:
+			for (i = 0; i < len; ++i, dst += step) {
+				unsigned char* b = (unsigned char*) dst;
+				b[0] = src[i]; b[1] = src[i] >> 8; b[2] = src[i] >> 16;
+			}
+			break;
+		case SND_PCM_FORMAT_S24_3BE:
+			for (i = 0; i < len; ++i, dst += step) {
+				unsigned char* b = (unsigned char*) dst;
+				b[2] = src[i]; b[1] = src[i] >> 8; b[0] = src[i] >> 16;
+			}
+			break;
+		case SND_PCM_FORMAT_S16_LE:
+		case SND_PCM_FORMAT_S16_BE:
+			swap = (fmt == SND_PCM_FORMAT_S16_BE) != NATIVE_BE;
+			for (i = 0; i < len; ++i, dst += step) {
+				const uint16_t v = src[i];
+				*((uint16_t*) dst) = swap ? __builtin_bswap16 (v) : v;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+/* full scale of formats which are dithered, 0: none */
+static float dither_scale (snd_pcm_format_t fmt)
+{
+	switch (fmt) {
+		case SND_PCM_FORMAT_S24_LE:
+		case SND_PCM_FORMAT_S24_BE:
+		case SND_PCM_FORMAT_S24_3LE:
+		case SND_PCM_FORMAT_S24_3BE:
+			return 8388608.f;
+		case SND_PCM_FORMAT_S16_LE:
+		case SND_PCM_FORMAT_S16_BE:
+			return 32768.f;
+		default:
+			return 0;
+	}
+}
+
+static int dither_setup (AlsaIO* io)
+{
+	unsigned int g, k;
+	io->dither_scale = io->dither != DITHER_NONE ? dither_scale (io->play_format) : 0;
+	if (io->dither_scale == 0) {
+		return 0;
+	}
+	io->n_dl = (io->play_nchan + 3) / 4;
+	if (posix_memalign ((void**) &io->dl, 16, io->n_dl * sizeof (DitherLanes))) {
+		io->dl = NULL;
+		io->dither_scale = 0;
+		return -1;
+	}
+	if (posix_memalign ((void**) &io->dq, 16, io->play_nchan * io->samples_per_period * sizeof (int32_t))) {
+		free (io->dl);
+		io->dl = NULL;
+		io->dq = NULL;
+		io->dither_scale = 0;
+		return -1;
+	}
+	memset (io->dl, 0, io->n_dl * sizeof (DitherLanes));
+	for (g = 0; g < io->n_dl; ++g) {
+		for (k = 0; k < 4; ++k) {
+			io->dl[g].rng[k] = 0x9e3779b9u * (4 * g + k + 1);
+		}
+	}
+	return 0;
+}
+
+/* quantize all playback channels, four channels per vector.
+ * TPDF: difference of two uniform 16 bit draws, +-1 LSB.
+ * shaped: 3 tap error feedback (F-weighted, Wannamaker),
+ * moves the noise floor out of the most sensitive band. */
+static void dither_period (AlsaIO* io)
+{
+	const snd_pcm_uframes_t len = io->samples_per_period;
+	const bool shaped = io->dither == DITHER_SHAPED;
+	const float s = io->dither_scale;
+	const v4sf scale = { s, s, s, s };
+	const v4sf lsb16 = { 1.f / 65536, 1.f / 65536, 1.f / 65536, 1.f / 65536 };
+	const v4sf half  = { .5f, .5f, .5f, .5f };
+	const v4sf h1    = { 1.623f, 1.623f, 1.623f, 1.623f };
+	const v4sf h2    = { -.982f, -.982f, -.982f, -.982f };
+	const v4sf h3    = { .109f, .109f, .109f, .109f };
+	const v4si vmax  = { s - 1, s - 1, s - 1, s - 1 };
+	const v4si vmin  = { -s, -s, -s, -s };
+	const v4su mask  = { 0xffff, 0xffff, 0xffff, 0xffff };
+	snd_pcm_uframes_t i;
+	unsigned int g, k, c;
+
+	for (g = 0; g < io->n_dl; ++g) {
+		DitherLanes* dl = &io->dl[g];
+		const float* src[4];
+		int32_t* dst[4];
+
+		for (k = 0; k < 4; ++k) {
+			c = 4 * g + k;
+			src[k] = io->testbuffers[c < io->play_nchan ? c : 0];
+			dst[k] = c < io->play_nchan ? io->dq + c * len : NULL;
+		}
+
+		v4su x  = dl->rng;
+		v4sf e1 = dl->e1;
+		v4sf e2 = dl->e2;
+		v4sf e3 = dl->e3;
+
+		for (i = 0; i < len; ++i) {
+			v4sf v = { src[0][i], src[1][i], src[2][i], src[3][i] };
+			v *= scale;
+			if (shaped) {
+				v -= h1 * e1 + h2 * e2 + h3 * e3;
+			}
+
+			/* xorshift32, one step per lane */
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			const v4si r = (v4si) (x >> 16) - (v4si) (x & mask);
+			const v4sf d = v + __builtin_convertvector (r, v4sf) * lsb16;
+
+			/* round to nearest */
+			v4si q = __builtin_convertvector (d, v4si);
+			const v4sf f = d - __builtin_convertvector (q, v4sf);
+			q -= (v4si) (f >= half);
+			q += (v4si) (f <= -half);
+
+			e3 = e2;
+			e2 = e1;
+			e1 = __builtin_convertvector (q, v4sf) - v;
+
+			/* clip */
+			const v4si hi = q > vmax;
+			const v4si lo = q < vmin;
+			q = (q & ~(hi | lo)) | (vmax & hi) | (vmin & lo);
+
+			for (k = 0; k < 4; ++k) {
+				if (dst[k]) {
+					dst[k][i] = q[k];
+				}
+			}
+		}
+
+		dl->rng = x;
+		dl->e1  = e1;
+		dl->e2  = e2;
+		dl->e3  = e3;
+	}
+
+	for (c = 0; c < io->play_nchan; ++c) {
+		write_chan_int (io->play_format, io->play_ptr [c], io->play_step, io->dq + c * len, len);
+	}
+}
+
 static int play_init (AlsaIO* io, snd_pcm_uframes_t len)
 {
 	int err;
@@ -335,12 +1271,16 @@ static int pcm_start (AlsaIO* io)
 	int err;
 	unsigned int i, j, n;
 
+	io->play_appl = 0;
+	io->capt_appl = 0;
+
 	if (io->play_handle) {
 		n = snd_pcm_avail_update (io->play_handle);
 		if (n != io->samples_per_period * io->play_periods_per_cycle) {
 			fprintf  (stderr, "full buffer not available at start (%u).\n", n);
 			return -1;
 		}
+		const uint64_t t0 = now_ns ();
 		for (i = 0; i < io->play_periods_per_cycle; i++) {
 			play_init (io, io->samples_per_period);
 			for (j = 0; j < io->play_nchan; j++) {
@@ -348,6 +1288,10 @@ static int pcm_start (AlsaIO* io)
 			}
 			play_done (io, io->samples_per_period);
 		}
+		if (!io->t_first_period) {
+			/* initial start, not a restart after x-run */
+			io->startup.prefill = now_ns () - t0;
+		}
 		if ((err = snd_pcm_start (io->play_handle)) < 0) {
 			fprintf (stderr, "pcm_start (play): %s.\n", snd_strerror (err));
 			return -1;
@@ -377,7 +1321,7 @@ static int pcm_stop (AlsaIO* io)
 	return 0;
 }
 
-static int recover (AlsaIO* io)
+static int recover_streams (AlsaIO* io)
 {
 	int err;
 	snd_pcm_status_t* stat;
@@ -385,6 +1329,12 @@ static int recover (AlsaIO* io)
 		printf("recover ()\n");
 	}
 
+	++io->stats.xruns;
+	++io->ival[io->ival_cur].xruns;
+	++io->phase_stats[io->phase].run.xruns;
+	io->cycle_flags |= TRACE_XRUN;
+	io->hwp[0].valid = io->hwp[1].valid = false;
+
 	snd_pcm_status_alloca (&stat);
 
 	if (io->play_handle) {
@@ -419,14 +1369,151 @@ static int recover (AlsaIO* io)
 	return 0;
 }
 
-static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
+static uint64_t gcd64 (uint64_t a, uint64_t b)
 {
-	bool              need_capt;
-	bool              need_play;
-	snd_pcm_sframes_t capt_av;
-	snd_pcm_sframes_t play_av;
-	unsigned short    rev;
-	int               i, r, n1, n2;
+	while (b) {
+		const uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* sample the hardware pointer of one stream and the time it was last
+ * updated by the driver. snd_pcm_status () would sync the pointer and
+ * timestamp to the time of the call, snd_pcm_htimestamp () does not. */
+static void hwptr_sample (AlsaIO* io, bool play, uint64_t t_wake)
+{
+	snd_pcm_uframes_t avail;
+	snd_htimestamp_t  ts;
+	snd_pcm_t* handle = play ? io->play_handle : io->capt_handle;
+	HwPtrStats* hs    = &io->hwp[play ? 0 : 1];
+
+	if (snd_pcm_state (handle) != SND_PCM_STATE_RUNNING || snd_pcm_htimestamp (handle, &avail, &ts) < 0) {
+		hs->valid = false;
+		return;
+	}
+
+	const uint64_t t_ptr = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	const int64_t  pos   = play
+		? (int64_t) io->play_appl + (int64_t) avail - (int64_t) (io->samples_per_period * io->play_periods_per_cycle)
+		: (int64_t) io->capt_appl + (int64_t) avail;
+
+	++hs->wakeups;
+	rs_add (&hs->lag, ((int64_t) t_wake - (int64_t) t_ptr) * 1e-3);
+
+	if (!hs->valid) {
+		hs->valid    = true;
+		hs->pos_prev = pos;
+		hs->ts_prev  = t_ptr;
+		return;
+	}
+
+	const int64_t step = pos - hs->pos_prev;
+	if (step <= 0 || t_ptr == hs->ts_prev) {
+		++hs->idle;
+		return;
+	}
+
+	rs_add (&hs->step, step);
+	rs_add (&hs->irq, (t_ptr - hs->ts_prev) * 1e-3);
+	hs->granule = gcd64 (hs->granule, step);
+	if (step % io->samples_per_period == 0) {
+		++hs->multiple;
+	}
+	hs->pos_prev = pos;
+	hs->ts_prev  = t_ptr;
+
+	/* Welford co-variance of position over time */
+	if (hs->n == 0) {
+		hs->t0 = t_ptr;
+		hs->p0 = pos;
+	}
+	const double t  = (t_ptr - hs->t0) * 1e-9;
+	const double p  = pos - hs->p0;
+	const double dt = t - hs->mean_t;
+	const double dp = p - hs->mean_p;
+	++hs->n;
+	hs->mean_t += dt / hs->n;
+	hs->mean_p += dp / hs->n;
+	hs->cov    += dt * (p - hs->mean_p);
+	hs->m2_t   += dt * (t - hs->mean_t);
+	hs->m2_p   += dp * (p - hs->mean_p);
+}
+
+static void print_hwptr_stats (const AlsaIO* io)
+{
+	int s;
+	const double period_us = 1e6 * io->samples_per_period / io->samplerate;
+
+	for (s = 0; s < 2; ++s) {
+		const HwPtrStats* hs = &io->hwp[s];
+		if (!(s == 0 ? io->play_handle : io->capt_handle) || hs->step.count == 0) {
+			continue;
+		}
+
+		const double rate  = hs->m2_t > 0 ? hs->cov / hs->m2_t : 0;
+		const double resid = hs->m2_t > 0 && hs->n > 2 ? (hs->m2_p - hs->cov * hs->cov / hs->m2_t) / (hs->n - 2) : 0;
+
+		fprintf (stdout, "%s hw pointer: %" PRIu64 " wakeups, %" PRIu64 " without pointer movement\n",
+				s == 0 ? "playback" : "capture", hs->wakeups, hs->idle);
+		fprintf (stdout, "  step     [frames]: min %.0f avg %.1f max %.0f, granularity %" PRIu64 ", %.1f%% period multiples\n",
+				hs->step.min, rs_mean (&hs->step), hs->step.max, hs->granule,
+				100. * hs->multiple / hs->step.count);
+		fprintf (stdout, "  update interval : min %.1f avg %.1f max %.1f stddev %.1f us (period %.1f us)\n",
+				hs->irq.min, rs_mean (&hs->irq), hs->irq.max, rs_stddev (&hs->irq), period_us);
+		fprintf (stdout, "  wakeup lag      : min %.1f avg %.1f max %.1f us after pointer update\n",
+				hs->lag.min, rs_mean (&hs->lag), hs->lag.max);
+		fprintf (stdout, "  linearity       : %.2f frames/s (%+.0f ppm), residual rms %.2f frames\n",
+				rate, 1e6 * (rate / io->samplerate - 1.0), resid > 0 ? sqrt (resid) : 0);
+
+		/* verdict */
+		if (hs->granule >= io->samples_per_period && hs->multiple == hs->step.count) {
+			fprintf (stdout, "  -> pointer is only updated per period (period IRQ granularity).\n");
+		} else {
+			fprintf (stdout, "  -> sub-period pointer updates, granularity %" PRIu64 " frames.\n", hs->granule);
+		}
+		if (rs_mean (&hs->step) > 1.5 * io->samples_per_period) {
+			fprintf (stdout, "  -> coarse bursts: %.1f periods per pointer update on average.\n",
+					rs_mean (&hs->step) / io->samples_per_period);
+		}
+		if (rs_mean (&hs->irq) > 0 && rs_stddev (&hs->irq) > .1 * rs_mean (&hs->irq)) {
+			fprintf (stdout, "  -> irregular update interval (%.0f%% deviation).\n",
+					100. * rs_stddev (&hs->irq) / rs_mean (&hs->irq));
+		}
+		if (rs_mean (&hs->lag) > .5 * period_us) {
+			fprintf (stdout, "  -> wakeups lag the pointer timestamp by %.2f periods on average.\n",
+					rs_mean (&hs->lag) / period_us);
+		}
+	}
+}
+
+static int recover (AlsaIO* io)
+{
+	int rv;
+	tmark (io, MARK_XRUN);
+	if (io->tracing_on_fd >= 0 && !io->tracing_stopped) {
+		/* freeze the ftrace ring-buffer, keep the lead-up to the first x-run */
+		io->tracing_stopped = write (io->tracing_on_fd, "0", 1) == 1;
+	}
+	tmark (io, MARK_RECOVER_START);
+	const uint64_t t0 = now_ns ();
+	rv = recover_streams (io);
+	const uint64_t dt = now_ns () - t0;
+	hist_add (&io->stats.recover, dt);
+	hist_add (&io->ival[io->ival_cur].recover, dt);
+	tmark (io, MARK_RECOVER_END);
+	return rv;
+}
+
+static snd_pcm_sframes_t pcm_avail (AlsaIO* io);
+
+static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
+{
+	bool              need_capt;
+	bool              need_play;
+	unsigned short    rev;
+	int               i, r, n1, n2;
 	struct pollfd     poll_fd [16];
 
 	need_capt = io->capt_handle ? true : false;
@@ -451,6 +1538,8 @@ static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
 		timeout.tv_sec = 1;
 		timeout.tv_nsec = 0;
 		r = ppoll (poll_fd, n2, &timeout, NULL);
+		++io->wait_calls;
+		tmark (io, MARK_WAKEUP);
 
 		if (r < 0) {
 			if (errno == EINTR) return 0;
@@ -458,14 +1547,27 @@ static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
 			return 0;
 		}
 		if (r == 0) {
+			tmark (io, MARK_TIMEOUT);
 			fprintf (stderr, "poll timed out.\n");
+			io->cycle_flags |= TRACE_TIMEOUT;
 			return 0;
 		}
 
+		if (io->hwptr_stats) {
+			const uint64_t t_wake = now_ns ();
+			if (io->play_handle) {
+				hwptr_sample (io, true, t_wake);
+			}
+			if (io->capt_handle) {
+				hwptr_sample (io, false, t_wake);
+			}
+		}
+
 		if (need_play) {
 			snd_pcm_poll_descriptors_revents (io->play_handle, poll_fd, n1, &rev);
 			if (rev & POLLERR) {
 				fprintf (stderr, "error on playback pollfd.\n");
+				io->cycle_flags |= TRACE_POLLERR;
 				recover (io);
 				return 0;
 			}
@@ -477,6 +1579,7 @@ static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
 			snd_pcm_poll_descriptors_revents (io->capt_handle, poll_fd + n1, n2 - n1, &rev);
 			if (rev & POLLERR) {
 				fprintf (stderr, "error on capture pollfd.\n");
+				io->cycle_flags |= TRACE_POLLERR;
 				recover (io);
 				return 0;
 			}
@@ -486,6 +1589,15 @@ static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
 		}
 	}
 
+	return pcm_avail (io);
+}
+
+/* frames that can be processed on both streams, 0 after x-run */
+static snd_pcm_sframes_t pcm_avail (AlsaIO* io)
+{
+	snd_pcm_sframes_t capt_av;
+	snd_pcm_sframes_t play_av;
+
 	play_av = 999999999;
 	if (io->play_handle && (play_av = snd_pcm_avail_update (io->play_handle)) < 0) {
 		if (io->debug) {
@@ -503,6 +1615,9 @@ static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
 		return 0;
 	}
 
+	io->play_avail = io->play_handle ? play_av : 0;
+	io->capt_avail = io->capt_handle ? capt_av : 0;
+
 	if (io->debug && io->play_handle && io->capt_handle && capt_av != play_av) {
 		fprintf (stderr, "async avail play:%ld capt:%ld\n", play_av, capt_av);
 	}
@@ -511,60 +1626,2938 @@ static snd_pcm_sframes_t pcm_wait (AlsaIO* io)
 }
 
 
-void *run_thread (void* arg) {
-	AlsaIO * io = arg;
+static void trace_flush (TraceRing* tr)
+{
+	const uint32_t head = __atomic_load_n (&tr->head, __ATOMIC_ACQUIRE);
+	uint32_t tail = tr->tail;
 
-	size_t loop;
-	size_t end = io->run_for * io->samplerate / io->samples_per_period;
+	while (tail != head) {
+		const uint32_t off = tail & (TRACE_RING - 1);
+		uint32_t n = head - tail;
+		if (off + n > TRACE_RING) {
+			n = TRACE_RING - off;
+		}
+		tr->written += fwrite (&tr->buf[off], sizeof (TraceRecord), n, tr->f);
+		tail += n;
+		__atomic_store_n (&tr->tail, tail, __ATOMIC_RELEASE);
+	}
+}
 
-	for (loop = 0; io->run_for <= 0 || loop < end; ++loop) {
-		int c;
-		long nr = pcm_wait (io);
+static void* trace_flush_thread (void* arg)
+{
+	TraceRing* tr = arg;
+	while (true) {
+		const bool quit = __atomic_load_n (&tr->quit, __ATOMIC_ACQUIRE);
+		trace_flush (tr);
+		if (quit) {
+			break;
+		}
+		usleep (50000);
+	}
+	fflush (tr->f);
+	return 0;
+}
 
-		if (io->debug) {
-			printf ("proc: %ld\n", nr);
+static int trace_open (AlsaIO* io, const char* path)
+{
+	TraceHeader hdr;
+	TraceRing* tr = (TraceRing*) calloc (1, sizeof (TraceRing));
+
+	if (!tr) {
+		fprintf (stderr, "cannot allocate trace ring.\n");
+		return -1;
+	}
+	if (!(tr->f = fopen (path, "wb"))) {
+		fprintf (stderr, "cannot open trace file '%s'\n", path);
+		free (tr);
+		return -1;
+	}
+
+	/* preallocate and pre-fault the ring. Not calloc () or a zero fill,
+	 * which may leave untouched zero pages to fault in the process thread */
+	if (!(tr->buf = (TraceRecord*) malloc (TRACE_RING * sizeof (TraceRecord)))) {
+		fprintf (stderr, "cannot allocate trace ring.\n");
+		fclose (tr->f);
+		free (tr);
+		return -1;
+	}
+	memset (tr->buf, 0x55, TRACE_RING * sizeof (TraceRecord));
+
+	memset (&hdr, 0, sizeof (hdr));
+	memcpy (hdr.magic, TRACE_MAGIC, 8);
+	hdr.version      = TRACE_VERSION;
+	hdr.record_size  = sizeof (TraceRecord);
+	hdr.samplerate   = io->samplerate;
+	hdr.period       = io->samples_per_period;
+	hdr.play_periods = io->play_handle ? io->play_periods_per_cycle : 0;
+	hdr.capt_periods = io->capt_handle ? io->capt_periods_per_cycle : 0;
+	hdr.play_nchan   = io->play_nchan;
+	hdr.capt_nchan   = io->capt_nchan;
+	fwrite (&hdr, sizeof (hdr), 1, tr->f);
+
+	if (io->engine == ENGINE_URING) {
+		/* the process thread submits writes with its wait */
+		fflush (tr->f);
+		tr->direct   = true;
+		tr->file_off = ftell (tr->f);
+	} else if (pthread_create (&tr->thread, NULL, trace_flush_thread, tr)) {
+		fprintf (stderr, "cannot create trace thread.\n");
+		fclose (tr->f);
+		free (tr->buf);
+		free (tr);
+		return -1;
+	}
+
+	io->trace = tr;
+	return 0;
+}
+
+static void trace_close (AlsaIO* io)
+{
+	TraceRing* tr = io->trace;
+	if (!tr) {
+		return;
+	}
+	if (tr->direct) {
+		/* remainder, less than one io_uring batch */
+		fseek (tr->f, tr->file_off, SEEK_SET);
+		trace_flush (tr);
+	} else {
+		__atomic_store_n (&tr->quit, true, __ATOMIC_RELEASE);
+		pthread_join (tr->thread, NULL);
+	}
+	fclose (tr->f);
+
+	fprintf (stdout, "trace: %" PRIu64 " records written, %" PRIu64 " dropped\n", tr->written, tr->dropped);
+
+	free (tr->buf);
+	free (tr);
+	io->trace = NULL;
+}
+
+/* called from the process thread once per cycle, no syscalls */
+static inline void trace_record (AlsaIO* io, uint64_t t_wake, uint64_t t_done, uint32_t periods)
+{
+	TraceRing* tr = io->trace;
+	const uint32_t head = tr->head;
+	const snd_pcm_sframes_t play_buf = io->samples_per_period * io->play_periods_per_cycle;
+
+	if (head - __atomic_load_n (&tr->tail, __ATOMIC_ACQUIRE) >= TRACE_RING) {
+		++tr->dropped;
+		++tr->seq;
+		return;
+	}
+
+	TraceRecord* r = &tr->buf[head & (TRACE_RING - 1)];
+	r->t_wake     = t_wake;
+	r->proc       = t_done - t_wake;
+	r->seq        = tr->seq++;
+	r->play_avail = io->play_avail;
+	r->capt_avail = io->capt_avail;
+	r->play_delay = io->play_handle ? play_buf - io->play_avail : 0;
+	r->capt_delay = io->capt_avail;
+	r->play_hwptr = io->play_handle ? io->play_appl + io->play_avail - play_buf : 0;
+	r->capt_hwptr = io->capt_appl + io->capt_avail;
+	r->periods    = periods;
+	r->flags      = io->cycle_flags;
+
+	__atomic_store_n (&tr->head, head + 1, __ATOMIC_RELEASE);
+}
+
+#ifdef HAVE_IO_URING
+
+#define URING_ENTRIES  32
+#define URING_UD_WRITE (~0ULL)
+#define URING_BATCH    64 /* trace records per write */
+
+static int uring_setup (unsigned int entries, struct io_uring_params* p)
+{
+	return syscall (__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter (Uring* u, unsigned int to_submit, unsigned int min_complete, uint64_t timeout)
+{
+	struct __kernel_timespec ts;
+	struct io_uring_getevents_arg arg;
+	unsigned int flags = IORING_ENTER_EXT_ARG;
+
+	memset (&arg, 0, sizeof (arg));
+	if (min_complete > 0) {
+		flags |= IORING_ENTER_GETEVENTS;
+		ts.tv_sec  = timeout / 1000000000ULL;
+		ts.tv_nsec = timeout % 1000000000ULL;
+		arg.ts     = (uint64_t) (uintptr_t) &ts;
+	}
+	return syscall (__NR_io_uring_enter, u->fd, to_submit, min_complete, flags, &arg, sizeof (arg));
+}
+
+static struct io_uring_sqe* uring_get_sqe (Uring* u)
+{
+	const uint32_t tail = *u->sq_tail;
+	if (tail - __atomic_load_n (u->sq_head, __ATOMIC_ACQUIRE) >= u->sq_entries) {
+		return NULL;
+	}
+	const uint32_t idx = tail & *u->sq_mask;
+	struct io_uring_sqe* sqe = &u->sqes[idx];
+	memset (sqe, 0, sizeof (*sqe));
+	u->sq_array[idx] = idx;
+	return sqe;
+}
+
+static void uring_queue_sqe (Uring* u)
+{
+	__atomic_store_n (u->sq_tail, *u->sq_tail + 1, __ATOMIC_RELEASE);
+	++u->to_submit;
+}
+
+/* multishot poll, stays armed until the kernel drops it */
+static int uring_arm (Uring* u, int i)
+{
+	struct io_uring_sqe* sqe = uring_get_sqe (u);
+	if (!sqe) {
+		return -1;
+	}
+	sqe->opcode       = IORING_OP_POLL_ADD;
+	sqe->fd           = u->pfd[i].fd;
+	sqe->poll32_events = u->pfd[i].events | POLLERR;
+	sqe->len          = IORING_POLL_ADD_MULTI;
+	sqe->user_data    = i;
+	uring_queue_sqe (u);
+	return 0;
+}
+
+static int uring_open (AlsaIO* io)
+{
+	struct io_uring_params p;
+	Uring* u = (Uring*) calloc (1, sizeof (Uring));
+	int i;
+
+	if (!u) {
+		fprintf (stderr, "io_uring: out of memory.\n");
+		return -1;
+	}
+	memset (&p, 0, sizeof (p));
+	p.flags = IORING_SETUP_COOP_TASKRUN;
+	if ((u->fd = uring_setup (URING_ENTRIES, &p)) < 0 && errno == EINVAL) {
+		/* kernel older than 5.19 */
+		memset (&p, 0, sizeof (p));
+		u->fd = uring_setup (URING_ENTRIES, &p);
+	}
+	if (u->fd < 0) {
+		fprintf (stderr, "io_uring_setup: %s\n", strerror (errno));
+		free (u);
+		return -1;
+	}
+	/* EXT_ARG is 5.11, multishot poll arrived with RSRC_TAGS in 5.13 */
+	if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_RSRC_TAGS)) {
+		fprintf (stderr, "io_uring: kernel too old, 5.13 or later is required.\n");
+		close (u->fd);
+		free (u);
+		return -1;
+	}
+
+	u->sq_entries = p.sq_entries;
+	u->ring_sz = p.sq_off.array + p.sq_entries * sizeof (uint32_t);
+	if (u->ring_sz < p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe)) {
+		u->ring_sz = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	}
+	u->sqes_sz = p.sq_entries * sizeof (struct io_uring_sqe);
+
+	u->ring = mmap (NULL, u->ring_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+	u->sqes = mmap (NULL, u->sqes_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+	if (u->ring == MAP_FAILED || u->sqes == MAP_FAILED) {
+		fprintf (stderr, "io_uring mmap: %s\n", strerror (errno));
+		if (u->ring != MAP_FAILED) {
+			munmap (u->ring, u->ring_sz);
+		}
+		close (u->fd);
+		free (u);
+		return -1;
+	}
+
+	char* r = (char*) u->ring;
+	u->sq_head  = (uint32_t*) (r + p.sq_off.head);
+	u->sq_tail  = (uint32_t*) (r + p.sq_off.tail);
+	u->sq_mask  = (uint32_t*) (r + p.sq_off.ring_mask);
+	u->sq_array = (uint32_t*) (r + p.sq_off.array);
+	u->cq_head  = (uint32_t*) (r + p.cq_off.head);
+	u->cq_tail  = (uint32_t*) (r + p.cq_off.tail);
+	u->cq_mask  = (uint32_t*) (r + p.cq_off.ring_mask);
+	u->cqes     = (struct io_uring_cqe*) (r + p.cq_off.cqes);
+
+	/* playback descriptors first, as in pcm_wait () */
+	if (io->play_handle) {
+		u->n_play = snd_pcm_poll_descriptors (io->play_handle, u->pfd, io->play_npfd);
+	}
+	if (io->capt_handle) {
+		u->n_pfd = u->n_play + snd_pcm_poll_descriptors (io->capt_handle, u->pfd + u->n_play, io->capt_npfd);
+	} else {
+		u->n_pfd = u->n_play;
+	}
+	for (i = 0; i < u->n_pfd; ++i) {
+		uring_arm (u, i);
+	}
+
+	io->uring = u;
+	return 0;
+}
+
+/* queue the next chunk of trace records, submitted with the next wait */
+static void uring_trace_write (AlsaIO* io)
+{
+	Uring* u = io->uring;
+	TraceRing* tr = io->trace;
+	const uint32_t tail = tr->tail;
+	const uint32_t off = tail & (TRACE_RING - 1);
+	uint32_t n = tr->head - tail;
+
+	if (u->write_n > 0 || n < URING_BATCH) {
+		return;
+	}
+	if (off + n > TRACE_RING) {
+		n = TRACE_RING - off;
+	}
+
+	struct io_uring_sqe* sqe = uring_get_sqe (u);
+	if (!sqe) {
+		return;
+	}
+	sqe->opcode    = IORING_OP_WRITE;
+	sqe->fd        = fileno (tr->f);
+	sqe->addr      = (uint64_t) (uintptr_t) &tr->buf[off];
+	sqe->len       = n * sizeof (TraceRecord);
+	sqe->off       = tr->file_off;
+	sqe->user_data = URING_UD_WRITE;
+	uring_queue_sqe (u);
+	u->write_n = n;
+}
+
+static void uring_reap (AlsaIO* io)
+{
+	Uring* u = io->uring;
+	uint32_t head = *u->cq_head;
+	const uint32_t tail = __atomic_load_n (u->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		const struct io_uring_cqe* cqe = &u->cqes[head & *u->cq_mask];
+		if (cqe->user_data == URING_UD_WRITE) {
+			TraceRing* tr = io->trace;
+			if (cqe->res == (int) (u->write_n * sizeof (TraceRecord))) {
+				tr->written  += u->write_n;
+				tr->file_off += cqe->res;
+			} else {
+				tr->dropped += u->write_n;
+			}
+			__atomic_store_n (&tr->tail, tr->tail + u->write_n, __ATOMIC_RELEASE);
+			u->write_n = 0;
+		} else if (cqe->user_data < (uint64_t) u->n_pfd) {
+			const int i = cqe->user_data;
+			if (cqe->res < 0) {
+				/* the request failed, this is not a device error */
+				if (!u->failed) {
+					if (cqe->res == -EINVAL) {
+						fprintf (stderr, "io_uring: multishot poll is not supported, kernel 5.13 or later is required.\n");
+					} else {
+						fprintf (stderr, "io_uring: poll request failed: %s\n", strerror (-cqe->res));
+					}
+				}
+				u->failed = true;
+			} else {
+				u->pfd[i].revents |= cqe->res;
+				if (!(cqe->flags & IORING_CQE_F_MORE)) {
+					uring_arm (u, i);
+				}
+			}
 		}
-		while (nr >= (long) io->samples_per_period) {
-			capt_init (io, io->samples_per_period);
-			for (c = 0; c < io->capt_nchan; ++c) {
-#if 0
-				char const *src = io->capt_ptr [c];
-				for (int i = 0; i < io->samples_per_period; ++i) {
-					io->testbuffers[c][i] = *((int *) src) / (float)0x7fffff00; // S32LE
-					src += io->capt_step;
+		++u->cqes_reaped;
+		++head;
+	}
+	__atomic_store_n (u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* same contract as pcm_wait (): frames available or 0 */
+static snd_pcm_sframes_t pcm_wait_uring (AlsaIO* io)
+{
+	Uring* u = io->uring;
+	unsigned short rev;
+	int i;
+
+	while (true) {
+		/* completions may already be queued, only enter the kernel to wait */
+		if (*u->cq_head == __atomic_load_n (u->cq_tail, __ATOMIC_ACQUIRE)) {
+			int r = uring_enter (u, u->to_submit, 1, 1000000000ULL);
+			++io->wait_calls;
+			if (r >= 0) {
+				u->to_submit -= r < (int) u->to_submit ? r : u->to_submit;
+				/* with pending submissions the call returns their count,
+				 * a timeout or signal then only shows as an empty CQ */
+				if (*u->cq_head == __atomic_load_n (u->cq_tail, __ATOMIC_ACQUIRE)) {
+					r = -1;
+					errno = signalled ? EINTR : ETIME;
 				}
-#endif
 			}
-			capt_done (io, io->samples_per_period);
+			if (r < 0) {
+				if (errno == EINTR) return 0;
+				if (errno == ETIME) {
+					tmark (io, MARK_TIMEOUT);
+					fprintf (stderr, "poll timed out.\n");
+					io->cycle_flags |= TRACE_TIMEOUT;
+					return 0;
+				}
+				fprintf (stderr, "io_uring_enter (): %s\n.", strerror (errno));
+				return 0;
+			}
+		}
+		tmark (io, MARK_WAKEUP);
+		uring_reap (io);
+		if (u->failed) {
+			return 0;
+		}
 
-			play_init (io, io->samples_per_period);
-			for (c = 0; c < io->play_nchan; ++c) {
-				char *dst = io->play_ptr [c];
-#if 0
-				for (int i = 0; i < io->samples_per_period; ++i) {
-					*((int *) dst) = io->testbuffers[c][i] * 0x7fffff00; // S32LE
-					dst += io->play_step;
-				}
-#elif 0
-				for (int i = 0; i < io->samples_per_period; ++i) {
-					*((int *) dst) = sin (M_PI * i / io->samples_per_period) * 0x7fffff00; // S32LE
-					dst += io->play_step;
+		if (io->play_handle) {
+			snd_pcm_poll_descriptors_revents (io->play_handle, u->pfd, u->n_play, &rev);
+			if (rev & POLLERR) {
+				fprintf (stderr, "error on playback pollfd.\n");
+				io->cycle_flags |= TRACE_POLLERR;
+				recover (io);
+				return 0;
+			}
+		}
+		if (io->capt_handle) {
+			snd_pcm_poll_descriptors_revents (io->capt_handle, u->pfd + u->n_play, u->n_pfd - u->n_play, &rev);
+			if (rev & POLLERR) {
+				fprintf (stderr, "error on capture pollfd.\n");
+				io->cycle_flags |= TRACE_POLLERR;
+				recover (io);
+				return 0;
+			}
+		}
+		for (i = 0; i < u->n_pfd; ++i) {
+			u->pfd[i].revents = 0;
+		}
+
+		/* a completion may be stale, check that a full period is ready */
+		const snd_pcm_sframes_t nr = pcm_avail (io);
+		if (io->cycle_flags & TRACE_XRUN) {
+			return 0;
+		}
+		if (nr >= (snd_pcm_sframes_t) io->samples_per_period) {
+			if (io->hwptr_stats) {
+				const uint64_t t_wake = now_ns ();
+				if (io->play_handle) {
+					hwptr_sample (io, true, t_wake);
 				}
+				if (io->capt_handle) {
+					hwptr_sample (io, false, t_wake);
+				}
+			}
+			return nr;
+		}
+	}
+}
+
+/* wait for an outstanding trace write, then release the ring */
+static void uring_close (AlsaIO* io)
+{
+	Uring* u = io->uring;
+	if (!u) {
+		return;
+	}
+	while (u->write_n > 0) {
+		if (uring_enter (u, u->to_submit, 1, 1000000000ULL) < 0 && errno != EINTR) {
+			break;
+		}
+		u->to_submit = 0;
+		uring_reap (io);
+	}
+	munmap (u->sqes, u->sqes_sz);
+	munmap (u->ring, u->ring_sz);
+	close (u->fd);
+	free (u);
+	io->uring = NULL;
+}
+
 #else
-				clear_chan (io, dst, io->samples_per_period);
+
+static int uring_open (AlsaIO* io)
+{
+	fprintf (stderr, "io_uring is not supported by this build.\n");
+	return -1;
+}
+
+static void uring_trace_write (AlsaIO* io) {}
+static snd_pcm_sframes_t pcm_wait_uring (AlsaIO* io) { return 0; }
+static void uring_close (AlsaIO* io) {}
+
 #endif
-			}
 
-			play_done (io, io->samples_per_period);
+/* convert a binary trace to CSV or chrome://tracing JSON on stdout */
+static int trace_export (const char* path, bool chrome)
+{
+	TraceHeader hdr;
+	TraceRecord r;
+	uint64_t t0 = 0;
+	bool first = true;
+	FILE* f = fopen (path, "rb");
+
+	if (!f) {
+		fprintf (stderr, "cannot open trace file '%s'\n", path);
+		return -1;
+	}
+	if (fread (&hdr, sizeof (hdr), 1, f) != 1
+			|| memcmp (hdr.magic, TRACE_MAGIC, 8)
+			|| hdr.version != TRACE_VERSION
+			|| hdr.record_size != sizeof (TraceRecord)) {
+		fprintf (stderr, "'%s' is not a compatible trace file.\n", path);
+		fclose (f);
+		return -1;
+	}
+
+	if (chrome) {
+		fprintf (stdout, "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"samplerate\": %u, \"period\": %u, \"play_periods\": %u, \"capt_periods\": %u},\n",
+				hdr.samplerate, hdr.period, hdr.play_periods, hdr.capt_periods);
+		fprintf (stdout, "\"traceEvents\": [\n");
+	} else {
+		fprintf (stdout, "# samplerate %u, period %u, play periods %u, capture periods %u\n",
+				hdr.samplerate, hdr.period, hdr.play_periods, hdr.capt_periods);
+		fprintf (stdout, "seq,t_wake_ns,proc_ns,periods,play_avail,capt_avail,play_delay,capt_delay,play_hwptr,capt_hwptr,xrun,timeout,pollerr\n");
+	}
+
+	while (fread (&r, sizeof (r), 1, f) == 1) {
+		if (first) {
+			t0 = r.t_wake;
+		}
+		if (!chrome) {
+			fprintf (stdout, "%u,%" PRIu64 ",%u,%u,%d,%d,%d,%d,%u,%u,%d,%d,%d\n",
+					r.seq, r.t_wake - t0, r.proc, r.periods,
+					r.play_avail, r.capt_avail, r.play_delay, r.capt_delay,
+					r.play_hwptr, r.capt_hwptr,
+					(r.flags & TRACE_XRUN) ? 1 : 0,
+					(r.flags & TRACE_TIMEOUT) ? 1 : 0,
+					(r.flags & TRACE_POLLERR) ? 1 : 0);
+			first = false;
+			continue;
+		}
+
+		const double ts = (r.t_wake - t0) * 1e-3; /* usec */
+		fprintf (stdout, "%s{\"name\": \"process\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"seq\": %u, \"periods\": %u}}",
+				first ? "" : ",\n", ts, r.proc * 1e-3, r.seq, r.periods);
+		fprintf (stdout, ",\n{\"name\": \"avail\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"play\": %d, \"capt\": %d}}",
+				ts, r.play_avail, r.capt_avail);
+		fprintf (stdout, ",\n{\"name\": \"delay\", \"ph\": \"C\", \"pid\": 1, \"ts\": %.3f, \"args\": {\"play\": %d, \"capt\": %d}}",
+				ts, r.play_delay, r.capt_delay);
+		if (r.flags) {
+			fprintf (stdout, ",\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"g\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f}",
+					(r.flags & TRACE_XRUN) ? "xrun" : (r.flags & TRACE_TIMEOUT) ? "timeout" : "pollerr", ts);
+		}
+		first = false;
+	}
+
+	if (chrome) {
+		fprintf (stdout, "\n]}\n");
+	}
+	fclose (f);
+	return 0;
+}
+
+/* per channel work of one period: convert capture to float,
+ * synthetic DSP load, analysis and convert back for playback */
+static void process_channel (AlsaIO* io, unsigned int c)
+{
+	unsigned int n;
+	snd_pcm_uframes_t i;
+	const snd_pcm_uframes_t len = io->samples_per_period;
+	float* buf = io->testbuffers[c];
+	ChanState* cs = &io->chan[c];
+
+	if (io->sine_gain > 0) {
+		const double w = 2 * M_PI * io->sine_freq / io->samplerate;
+		double phase = cs->phase;
+		for (i = 0; i < len; ++i) {
+			buf[i] = io->sine_gain * sin (phase);
+			phase += w;
+		}
+		cs->phase = fmod (phase, 2 * M_PI);
+	} else if (c < io->capt_nchan) {
+		read_chan (io->capt_format, io->capt_ptr [c], io->capt_step, buf, len);
+	}
+
+	/* emulate plugin DSP: 2nd order low-pass, `dsp_load` passes */
+	for (n = 0; n < io->dsp_load; ++n) {
+		float* out = io->scratch[c];
+		float z1 = cs->z1;
+		float z2 = cs->z2;
+		for (i = 0; i < len; ++i) {
+			const float y = .0675f * buf[i] + z1;
+			z1 = .135f * buf[i] + 1.143f * y + z2;
+			z2 = .0675f * buf[i] - .413f * y;
+			out[i] = y;
+		}
+		cs->z1 = z1;
+		cs->z2 = z2;
+		cs->sink += out[len - 1];
+	}
+
+	float peak = 0;
+	for (i = 0; i < len; ++i) {
+		const float a = fabsf (buf[i]);
+		if (a > peak) {
+			peak = a;
+		}
+	}
+	if (peak > cs->peak) {
+		cs->peak = peak;
+	}
+
+	if (c < io->play_nchan && io->dither_scale == 0) {
+		write_chan (io->play_format, io->play_ptr [c], io->play_step, buf, len);
+	}
+}
+
+static long futex_wait (int* addr, int val)
+{
+	return syscall (SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static long futex_wake (int* addr)
+{
+	return syscall (SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* claim jobs of generation `gen` only, a helper which is late for
+ * its period must not take a job of the next one.
+ * The time of each job is published before the job is released,
+ * so the joiner sees all of it once `pending` drops to zero */
+static void pool_run_jobs (AlsaIO* io, int gen, uint64_t* busy)
+{
+	WorkerPool* pool = &io->pool;
+	uint64_t t = __atomic_load_n (&pool->ticket, __ATOMIC_ACQUIRE);
+	while ((uint32_t) (t >> 32) == (uint32_t) gen && (uint32_t) t < pool->n_jobs) {
+		if (!__atomic_compare_exchange_n (&pool->ticket, &t, t + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+			continue;
+		}
+		const uint64_t t0 = now_ns ();
+		process_channel (io, (uint32_t) t);
+		__atomic_fetch_add (busy, now_ns () - t0, __ATOMIC_RELAXED);
+		__atomic_fetch_sub (&pool->pending, 1, __ATOMIC_RELEASE);
+		t = __atomic_load_n (&pool->ticket, __ATOMIC_ACQUIRE);
+	}
+}
+
+static void* worker_thread (void* arg)
+{
+	Worker* w = arg;
+	AlsaIO* io = w->io;
+	WorkerPool* pool = &io->pool;
+	int seen = 0;
+
+	while (true) {
+		int gen, spin;
+		for (spin = 0; spin < WORKER_SPIN; ++spin) {
+			if ((gen = __atomic_load_n (&pool->generation, __ATOMIC_ACQUIRE)) != seen) {
+				break;
+			}
+			cpu_relax ();
+		}
+		while ((gen = __atomic_load_n (&pool->generation, __ATOMIC_ACQUIRE)) == seen) {
+			__atomic_fetch_add (&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+			futex_wait (&pool->generation, seen);
+			__atomic_fetch_sub (&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+		}
+		seen = gen;
+
+		if (__atomic_load_n (&pool->quit, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		if (w->id >= __atomic_load_n (&pool->active, __ATOMIC_RELAXED)) {
+			continue;
+		}
+		pool_run_jobs (io, gen, &w->busy);
+	}
+	return 0;
+}
+
+/* process all channels of the current period, returns wall-time [ns] */
+static uint64_t pool_process (AlsaIO* io, uint64_t* work)
+{
+	WorkerPool* pool = &io->pool;
+	unsigned int w;
+	const uint64_t t0 = now_ns ();
+
+	if (pool->active == 0) {
+		unsigned int c;
+		for (c = 0; c < io->n_bufs; ++c) {
+			process_channel (io, c);
+		}
+		*work = now_ns () - t0;
+		return *work;
+	}
+
+	/* fork, the ticket publishes `pending` and this period's buffers */
+	const int gen = __atomic_load_n (&pool->generation, __ATOMIC_RELAXED) + 1;
+	__atomic_store_n (&pool->pending, pool->n_jobs, __ATOMIC_RELAXED);
+	__atomic_store_n (&pool->ticket, (uint64_t) (uint32_t) gen << 32, __ATOMIC_RELEASE);
+	__atomic_store_n (&pool->generation, gen, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n (&pool->sleepers, __ATOMIC_SEQ_CST) > 0) {
+		futex_wake (&pool->generation);
+	}
+
+	*work = 0;
+	pool_run_jobs (io, gen, work);
+
+	/* join */
+	while (__atomic_load_n (&pool->pending, __ATOMIC_ACQUIRE) > 0) {
+		cpu_relax ();
+	}
+
+	const uint64_t wall = now_ns () - t0;
+	for (w = 0; w < pool->active; ++w) {
+		*work += __atomic_exchange_n (&pool->workers[w].busy, 0, __ATOMIC_RELAXED);
+	}
+	return wall;
+}
+
+static void pin_thread (pthread_t thread, int cpu)
+{
+	cpu_set_t cpuset;
+	CPU_ZERO (&cpuset);
+	CPU_SET (cpu, &cpuset);
+	if (pthread_setaffinity_np (thread, sizeof (cpu_set_t), &cpuset)) {
+		fprintf (stderr, "cannot pin thread to CPU %d\n", cpu);
+	}
+}
+
+static int pool_start (AlsaIO* io, int rt_priority)
+{
+	WorkerPool* pool = &io->pool;
+	const int n_cpu = sysconf (_SC_NPROCESSORS_ONLN);
+	unsigned int w;
+
+	pool->n_workers = io->n_threads > 1 ? io->n_threads - 1 : 0;
+	pool->n_jobs    = io->n_bufs;
+	pool->active    = pool->n_workers;
+	pool->workers   = (Worker*) calloc (pool->n_workers > 0 ? pool->n_workers : 1, sizeof (Worker));
+
+	for (w = 0; w < pool->n_workers; ++w) {
+		int err;
+		Worker* wk = &pool->workers[w];
+		wk->io = io;
+		wk->id = w;
+		if (rt_priority < 0) {
+			err = realtime_pthread_create (SCHED_FIFO, rt_priority, 100000, &wk->thread, worker_thread, wk);
+		} else {
+			err = pthread_create (&wk->thread, NULL, worker_thread, wk);
+		}
+		if (err) {
+			fprintf (stderr, "cannot create worker thread %u.\n", w);
+			pool->n_workers = w;
+			pool->active    = w;
+			return -1;
+		}
+		/* the process thread is pinned to CPU 0, helpers use the remaining cores */
+		pin_thread (wk->thread, (w + 1) % n_cpu);
+	}
+	return 0;
+}
+
+static void pool_stop (AlsaIO* io)
+{
+	WorkerPool* pool = &io->pool;
+	unsigned int w;
+
+	__atomic_store_n (&pool->quit, true, __ATOMIC_RELEASE);
+	__atomic_fetch_add (&pool->generation, 1, __ATOMIC_SEQ_CST);
+	futex_wake (&pool->generation);
+
+	for (w = 0; w < pool->n_workers; ++w) {
+		pthread_join (pool->workers[w].thread, NULL);
+	}
+	free (pool->workers);
+	memset (pool, 0, sizeof (WorkerPool));
+}
+
+static void phase_enter (AlsaIO* io, unsigned int phase)
+{
+	if (io->scaling) {
+		io->pool.active = phase;
+	}
+	io->phase_stats[phase].threads = io->pool.active + 1;
+	io->phase_stats[phase].run.t_start = now_ns ();
+	if (phase > 0) {
+		io->phase_stats[phase - 1].run.t_end = io->phase_stats[phase].run.t_start;
+	}
+	/* stressor threads poll the current phase */
+	__atomic_store_n (&io->phase, phase, __ATOMIC_RELEASE);
+}
+
+static void process_period (AlsaIO* io, unsigned int phase)
+{
+	int c;
+	capt_init (io, io->samples_per_period);
+	play_init (io, io->samples_per_period);
+
+	if (io->process) {
+		uint64_t work;
+		PhaseStats* ps = &io->phase_stats[phase];
+		const uint64_t wall = pool_process (io, &work);
+		const double threads = ps->threads;
+		rs_add (&ps->work, work * 1e-3);
+		rs_add (&ps->wall, wall * 1e-3);
+		rs_add (&ps->overhead, (wall - work / threads) * 1e-3);
+		if (io->dither_scale > 0) {
+			/* all channels at once, after the join */
+			dither_period (io);
+		}
+	} else {
+		for (c = 0; c < io->play_nchan; ++c) {
+			clear_chan (io, io->play_ptr [c], io->samples_per_period);
+		}
+	}
+
+	capt_done (io, io->samples_per_period);
+	play_done (io, io->samples_per_period);
+}
+
+/* a captured sample is written to playback in the same cycle,
+ * the sum of both delays is the capture to playback offset */
+static void latency_sample (AlsaIO* io)
+{
+	snd_pcm_sframes_t play_delay = 0;
+	snd_pcm_sframes_t capt_delay = 0;
+	if (io->play_handle && snd_pcm_delay (io->play_handle, &play_delay) < 0) {
+		return;
+	}
+	if (io->capt_handle && snd_pcm_delay (io->capt_handle, &capt_delay) < 0) {
+		return;
+	}
+	if (io->play_handle) {
+		rs_add (&io->lat_play, play_delay);
+	}
+	if (io->capt_handle) {
+		rs_add (&io->lat_capt, capt_delay);
+	}
+	if (io->play_handle && io->capt_handle) {
+		rs_add (&io->lat_rtt, play_delay + capt_delay);
+	}
+}
+
+/* process all available periods after a wakeup and collect statistics */
+static void run_cycle (AlsaIO* io, long nr, uint64_t t_wake, unsigned int phase)
+{
+	RunStats* ival = &io->ival[io->ival_cur];
+
+	if (io->debug) {
+		printf ("proc: %ld\n", nr);
+	}
+	if (nr < (long) io->samples_per_period) {
+		/* x-run or timeout, don't count recovery as wakeup interval */
+		io->t_prev = 0;
+	} else {
+		/* frames beyond the period that woke us up */
+		const uint64_t late = (uint64_t) (nr - io->samples_per_period) * 1000000000ULL / io->samplerate;
+		hist_add (&io->stats.late, late);
+		hist_add (&ival->late, late);
+		hist_add (&io->phase_stats[phase].run.late, late);
+	}
+
+	uint32_t periods = 0;
+	while (nr >= (long) io->samples_per_period) {
+		tmark (io, MARK_PERIOD_START);
+		process_period (io, phase);
+		tmark (io, MARK_PERIOD_END);
+
+		/* single writer, a relaxed atomic store is sufficient */
+		__atomic_store_n (&io->heartbeat, io->heartbeat + 1, __ATOMIC_RELAXED);
+
+		nr -= io->samples_per_period;
+		++periods;
+		++io->stats.periods;
+		++ival->periods;
+		++io->phase_stats[phase].run.periods;
+
+		if (!io->t_first_period) {
+			io->t_first_period = now_ns ();
+		}
+	}
+
+	const uint64_t t_done = now_ns ();
+	if (io->t_prev) {
+		hist_add (&io->stats.wake, t_wake - io->t_prev);
+		hist_add (&io->stats.proc, t_done - t_wake);
+		hist_add (&ival->wake, t_wake - io->t_prev);
+		hist_add (&ival->proc, t_done - t_wake);
+		hist_add (&io->phase_stats[phase].run.wake, t_wake - io->t_prev);
+		hist_add (&io->phase_stats[phase].run.proc, t_done - t_wake);
+	}
+	io->t_prev = t_wake;
+
+	if (io->latency && periods > 0) {
+		latency_sample (io);
+	}
+
+	if (io->trace) {
+		trace_record (io, t_wake, t_done, periods);
+		if (io->uring) {
+			uring_trace_write (io);
+		}
+	}
+	io->cycle_flags = 0;
+
+	/* hand over the soak interval, unless the previous one was not yet reported */
+	if (io->soak_interval > 0 && t_wake - ival->t_start >= io->soak_interval
+			&& !__atomic_load_n (&io->ival_ready, __ATOMIC_ACQUIRE)) {
+		ival->t_end = t_wake;
+		io->ival_cur ^= 1;
+		io->ival[io->ival_cur].t_start = t_wake;
+		__atomic_store_n (&io->ival_ready, true, __ATOMIC_RELEASE);
+	}
+}
+
+void *run_thread (void* arg) {
+	AlsaIO * io = arg;
+
+	size_t loop;
+	size_t end = io->run_for * io->samplerate / io->samples_per_period;
+	unsigned int phase = 0;
+	struct rusage ru;
+
+	if (io->n_phases > 1) {
+		io->phase_periods = end;
+		end *= io->n_phases;
+	}
+	phase_enter (io, 0);
+	__atomic_store_n (&io->rt_tid, (pid_t) syscall (SYS_gettid), __ATOMIC_RELEASE);
+
+	getrusage (RUSAGE_THREAD, &ru);
+	io->ctxsw = -(ru.ru_nvcsw + ru.ru_nivcsw);
+
+	io->t_prev = 0;
+	io->stats.t_start = io->ival[io->ival_cur].t_start = now_ns ();
+
+	for (loop = 0; io->run_for <= 0 || loop < end; ++loop) {
+		long nr = io->uring ? pcm_wait_uring (io) : pcm_wait (io);
+		const uint64_t t_wake = now_ns ();
+
+		if (io->n_phases > 1 && loop / io->phase_periods != phase) {
+			phase = loop / io->phase_periods;
+			phase_enter (io, phase);
+		}
+
+		run_cycle (io, nr, t_wake, phase);
+
+		if (signalled || (io->uring && io->uring->failed) || (io->first_period_only && io->t_first_period)) {
+			break;
+		}
+	}
+
+	io->stats.t_end = now_ns ();
+	io->phase_stats[phase].run.t_end = io->stats.t_end;
+	getrusage (RUSAGE_THREAD, &ru);
+	io->ctxsw += ru.ru_nvcsw + ru.ru_nivcsw;
+	__atomic_store_n (&io->thread_done, true, __ATOMIC_RELEASE);
+	pthread_exit (0);
+	return 0;
+}
+
+/* service all streams from a single thread and one ppoll () */
+void *run_multi_thread (void* arg) {
+	MultiIO* m = arg;
+	unsigned int i;
+	int n;
+
+	m->t_start = now_ns ();
+	const pid_t tid = syscall (SYS_gettid);
+	for (i = 0; i < m->n_streams; ++i) {
+		AlsaIO* io = m->streams[i].io;
+		phase_enter (io, 0);
+		__atomic_store_n (&io->rt_tid, tid, __ATOMIC_RELEASE);
+		io->t_prev = 0;
+		io->stats.t_start = io->ival[io->ival_cur].t_start = m->t_start;
+		m->streams[i].need_play = io->play_handle != NULL;
+		m->streams[i].need_capt = io->capt_handle != NULL;
+	}
+
+	while (!signalled && (m->run_for <= 0 || now_ns () - m->t_start < m->run_for * 1e9)) {
+		struct timespec timeout;
+		unsigned int serviced = 0;
+
+		n = 0;
+		for (i = 0; i < m->n_streams; ++i) {
+			MultiStream* ms = &m->streams[i];
+			if (ms->need_play) {
+				ms->pfd_play = n;
+				n += snd_pcm_poll_descriptors (ms->io->play_handle, m->pfd + n, ms->io->play_npfd);
+			}
+			if (ms->need_capt) {
+				ms->pfd_capt = n;
+				n += snd_pcm_poll_descriptors (ms->io->capt_handle, m->pfd + n, ms->io->capt_npfd);
+			}
+		}
+		for (i = 0; i < (unsigned int) n; ++i) {
+			m->pfd[i].events |= POLLERR;
+		}
+
+		timeout.tv_sec  = 1;
+		timeout.tv_nsec = 0;
+		const int r = ppoll (m->pfd, n, &timeout, NULL);
+		const uint64_t t_wake = now_ns ();
+		++m->wakeups;
+
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			fprintf (stderr, "poll (): %s\n.", strerror (errno));
+			continue;
+		}
+		if (r == 0) {
+			fprintf (stderr, "poll timed out.\n");
+			continue;
+		}
+
+		for (i = 0; i < m->n_streams; ++i) {
+			MultiStream* ms = &m->streams[i];
+			AlsaIO* io = ms->io;
+			unsigned short rev;
+			bool err = false;
+
+			if (ms->need_play) {
+				snd_pcm_poll_descriptors_revents (io->play_handle, m->pfd + ms->pfd_play, io->play_npfd, &rev);
+				err |= (rev & POLLERR) != 0;
+				if (rev & POLLOUT) {
+					ms->need_play = false;
+				}
+			}
+			if (ms->need_capt) {
+				snd_pcm_poll_descriptors_revents (io->capt_handle, m->pfd + ms->pfd_capt, io->capt_npfd, &rev);
+				err |= (rev & POLLERR) != 0;
+				if (rev & POLLIN) {
+					ms->need_capt = false;
+				}
+			}
+
+			if (err) {
+				fprintf (stderr, "error on %s pollfd.\n", io->name);
+				recover (io);
+				run_cycle (io, 0, t_wake, 0);
+			} else if (!ms->need_play && !ms->need_capt) {
+				if (io->hwptr_stats && io->play_handle) {
+					hwptr_sample (io, true, t_wake);
+				}
+				if (io->hwptr_stats && io->capt_handle) {
+					hwptr_sample (io, false, t_wake);
+				}
+				run_cycle (io, pcm_avail (io), t_wake, 0);
+				++serviced;
+			} else {
+				continue;
+			}
+			ms->need_play = io->play_handle != NULL;
+			ms->need_capt = io->capt_handle != NULL;
+		}
+
+		const uint64_t t_done = now_ns ();
+		if (serviced > 0) {
+			hist_add (&m->service, t_done - t_wake);
+			rs_add (&m->ready, serviced);
+			m->busy += t_done - t_wake;
+		}
+	}
+
+	m->t_end = now_ns ();
+	for (i = 0; i < m->n_streams; ++i) {
+		m->streams[i].io->stats.t_end = m->t_end;
+		__atomic_store_n (&m->streams[i].io->thread_done, true, __ATOMIC_RELEASE);
+	}
+	pthread_exit (0);
+	return 0;
+}
+
+#define SOAK_WORST 5
+
+typedef struct {
+	unsigned int n;
+	uint64_t     t_start;
+	uint64_t     t_end;
+	uint64_t     periods;
+	uint64_t     xruns;
+	uint64_t     wake_max;
+	uint64_t     proc_max;
+} SoakRecord;
+
+static void print_soak_interval (const AlsaIO* io, unsigned int n, const RunStats* rs)
+{
+	fprintf (stdout, "soak %6u %+9.1fs %8.1fs periods %8" PRIu64 " xruns %3" PRIu64 " ",
+			n,
+			(rs->t_start - io->stats.t_start) * 1e-9,
+			(rs->t_end - rs->t_start) * 1e-9,
+			rs->periods, rs->xruns);
+	fprintf (stdout, "wake p50 %.3f p99 %.3f max %.3f proc p50 %.3f p99 %.3f max %.3f ms\n",
+			hist_percentile (&rs->wake, .5) * 1e-6,
+			hist_percentile (&rs->wake, .99) * 1e-6,
+			rs->wake.max * 1e-6,
+			hist_percentile (&rs->proc, .5) * 1e-6,
+			hist_percentile (&rs->proc, .99) * 1e-6,
+			rs->proc.max * 1e-6);
+	fflush (stdout);
+}
+
+/* keep the intervals with the longest wakeup interval, most xruns first */
+static void soak_rank (SoakRecord* worst, unsigned int n, const RunStats* rs)
+{
+	int i;
+	SoakRecord r;
+	r.n        = n;
+	r.t_start  = rs->t_start;
+	r.t_end    = rs->t_end;
+	r.periods  = rs->periods;
+	r.xruns    = rs->xruns;
+	r.wake_max = rs->wake.max;
+	r.proc_max = rs->proc.max;
+
+	for (i = SOAK_WORST - 1; i >= 0; --i) {
+		const SoakRecord* w = &worst[i];
+		const bool worse = w->periods == 0
+			|| r.xruns > w->xruns
+			|| (r.xruns == w->xruns && r.wake_max > w->wake_max);
+		if (!worse) {
+			break;
+		}
+		if (i < SOAK_WORST - 1) {
+			worst[i + 1] = worst[i];
+		}
+		worst[i] = r;
+	}
+}
+
+/* collect and print soak intervals while the process thread runs, uses constant memory */
+static void soak_monitor (AlsaIO* io)
+{
+	unsigned int n = 0;
+	unsigned int i;
+	SoakRecord worst[SOAK_WORST];
+	memset (worst, 0, sizeof (worst));
+
+	while (true) {
+		const bool done = __atomic_load_n (&io->thread_done, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n (&io->ival_ready, __ATOMIC_ACQUIRE)) {
+			RunStats* rs = &io->ival[io->ival_cur ^ 1];
+			print_soak_interval (io, n, rs);
+			soak_rank (worst, n, rs);
+			++n;
+			stats_reset (rs);
+			__atomic_store_n (&io->ival_ready, false, __ATOMIC_RELEASE);
+		} else if (done) {
+			break;
+		} else {
+			usleep (100000);
+		}
+	}
+
+	/* partial last interval */
+	RunStats* rs = &io->ival[io->ival_cur];
+	if (rs->periods > 0) {
+		rs->t_end = io->stats.t_end;
+		print_soak_interval (io, n, rs);
+		soak_rank (worst, n, rs);
+	}
+
+	fprintf (stdout, "soak worst intervals:\n");
+	for (i = 0; i < SOAK_WORST && worst[i].periods > 0; ++i) {
+		fprintf (stdout, "  #%-6u %+9.1fs xruns %3" PRIu64 " wake max %.3f ms proc max %.3f ms\n",
+				worst[i].n,
+				(worst[i].t_start - io->stats.t_start) * 1e-9,
+				worst[i].xruns,
+				worst[i].wake_max * 1e-6,
+				worst[i].proc_max * 1e-6);
+	}
+}
+
+static void print_throughput (const AlsaIO* io)
+{
+	const RunStats* rs = &io->stats;
+	if (rs->t_end <= rs->t_start) {
+		return;
+	}
+	const double frames = rs->periods * (double) io->samples_per_period / ((rs->t_end - rs->t_start) * 1e-9);
+	if (io->play_handle) {
+		fprintf (stdout, "  playback  : %10.0f frames/s %9.3f MB/s (%u ch, %zu bytes/sample)\n",
+				frames, frames * io->play_nchan * io->play_bytes_per_sample * 1e-6,
+				io->play_nchan, io->play_bytes_per_sample);
+	}
+	if (io->capt_handle) {
+		fprintf (stdout, "  capture   : %10.0f frames/s %9.3f MB/s (%u ch, %zu bytes/sample)\n",
+				frames, frames * io->capt_nchan * io->capt_bytes_per_sample * 1e-6,
+				io->capt_nchan, io->capt_bytes_per_sample);
+	}
+}
+
+/* theoretical latency: capture waits for a full period, playback
+ * queues the written period behind the remainder of the buffer */
+static void print_latency_budget (const AlsaIO* io)
+{
+	const double ms = 1000. / io->samplerate;
+	const snd_pcm_uframes_t capt = io->samples_per_period;
+	const snd_pcm_uframes_t play = io->samples_per_period * (io->play_periods_per_cycle - 1);
+
+	fprintf (stdout, "latency budget %s:\n", io->name);
+	if (io->capt_handle) {
+		fprintf (stdout, "  capture    : %6lu frames %8.3f ms (1 period)\n", capt, capt * ms);
+	}
+	if (io->play_handle) {
+		fprintf (stdout, "  playback   : %6lu frames %8.3f ms (%u of %u periods queued)\n",
+				play, play * ms, io->play_periods_per_cycle - 1, io->play_periods_per_cycle);
+	}
+	if (io->play_handle && io->capt_handle) {
+		fprintf (stdout, "  round trip : %6lu frames %8.3f ms%s\n", capt + play, (capt + play) * ms,
+				io->synced ? "" : " + start offset (streams are not linked)");
+	}
+}
+
+static void print_latency_line (const char* name, const RunningStat* rs, double nominal, double ms)
+{
+	if (rs->count == 0) {
+		return;
+	}
+	fprintf (stdout, "  %-10s : min %6.0f avg %8.1f max %6.0f frames, avg %8.3f ms (%+.1f frames)\n",
+			name, rs->min, rs_mean (rs), rs->max, rs_mean (rs) * ms, rs_mean (rs) - nominal);
+}
+
+static void print_latency_stats (const AlsaIO* io)
+{
+	const double ms = 1000. / io->samplerate;
+	const double capt = io->samples_per_period;
+	const double play = io->samples_per_period * (io->play_periods_per_cycle - 1.);
+
+	/* measured right after a cycle: the written period is still queued,
+	 * the captured period has been read */
+	fprintf (stdout, "measured delay after each cycle %s:\n", io->name);
+	print_latency_line ("capture", &io->lat_capt, 0, ms);
+	print_latency_line ("playback", &io->lat_play, play + io->samples_per_period, ms);
+	print_latency_line ("round trip", &io->lat_rtt, capt + play, ms);
+}
+
+static void print_engine_stats (const AlsaIO* io)
+{
+	const double periods = io->stats.periods > 0 ? io->stats.periods : 1;
+	fprintf (stdout, "engine: %s, %.2f wait syscalls and %.2f context switches per period, wakeup lateness p50 %.3f p99 %.3f ms\n",
+			io->engine == ENGINE_URING ? "io_uring" : "ppoll",
+			io->wait_calls / periods, io->ctxsw / periods,
+			hist_percentile (&io->stats.late, .5) * 1e-6,
+			hist_percentile (&io->stats.late, .99) * 1e-6);
+}
+
+static void print_run_hists (const AlsaIO* io)
+{
+	const RunStats* rs = &io->stats;
+	print_hist (stdout, "  wakeup interval:", &rs->wake);
+	fprintf (stdout, "\n");
+	print_hist (stdout, "  wakeup lateness:", &rs->late);
+	fprintf (stdout, "\n");
+	print_hist (stdout, "  processing     :", &rs->proc);
+	fprintf (stdout, "\n");
+	if (rs->recover.count > 0) {
+		print_hist (stdout, "  x-run recovery :", &rs->recover);
+		fprintf (stdout, "\n");
+	}
+}
+
+static void print_run_stats (const AlsaIO* io)
+{
+	const RunStats* rs = &io->stats;
+	fprintf (stdout, "run: %.1fs, %" PRIu64 " periods, %" PRIu64 " xruns (nominal period %.3f ms)\n",
+			(rs->t_end - rs->t_start) * 1e-9, rs->periods, rs->xruns,
+			1000.0 * io->samples_per_period / io->samplerate);
+	print_run_hists (io);
+	fprintf (stdout, "throughput:\n");
+	print_throughput (io);
+}
+
+static void print_stream_line (const AlsaIO* io)
+{
+	const RunStats* rs = &io->stats;
+	fprintf (stdout, "  %-24s %9" PRIu64 " %6" PRIu64 " %9.3f %9.3f %9.3f %9.3f\n",
+			io->name, rs->periods, rs->xruns,
+			hist_percentile (&rs->wake, .5) * 1e-6,
+			hist_percentile (&rs->wake, .99) * 1e-6,
+			rs->wake.max * 1e-6,
+			rs->proc.max * 1e-6);
+}
+
+static void print_multi_stats (AlsaIO** ios, unsigned int n_io, const MultiIO* m)
+{
+	unsigned int i;
+	uint64_t periods = 0;
+	uint64_t xruns = 0;
+	double wake_max = 0;
+
+	fprintf (stdout, "streams: %u, serviced by %s\n", n_io, m ? "one event loop" : "one thread per device");
+	fprintf (stdout, "  %-24s %9s %6s %9s %9s %9s %9s\n",
+			"device", "periods", "xruns", "wake p50", "wake p99", "wake max", "proc max");
+	for (i = 0; i < n_io; ++i) {
+		const AlsaIO* io = ios[i];
+		print_stream_line (io);
+		periods += io->stats.periods;
+		xruns   += io->stats.xruns;
+		if (io->stats.wake.max * 1e-6 > wake_max) {
+			wake_max = io->stats.wake.max * 1e-6;
+		}
+	}
+	fprintf (stdout, "  %-24s %9" PRIu64 " %6" PRIu64 " %29.3f   [ms]\n", "total", periods, xruns, wake_max);
+
+	fprintf (stdout, "throughput:\n");
+	for (i = 0; i < n_io; ++i) {
+		fprintf (stdout, " %s\n", ios[i]->name);
+		print_throughput (ios[i]);
+	}
+
+	if (!m || m->t_end <= m->t_start) {
+		return;
+	}
+	const double wall = (m->t_end - m->t_start) * 1e-9;
+	fprintf (stdout, "event loop: %" PRIu64 " wakeups (%.0f/s), %.2f streams per wakeup, %.1f%% busy\n",
+			m->wakeups, m->wakeups / wall, rs_mean (&m->ready), 100. * m->busy * 1e-9 / wall);
+	print_hist (stdout, "  service time per wakeup:", &m->service);
+	fprintf (stdout, "\n");
+	if (xruns > 0 && 100. * m->busy * 1e-9 / wall > 50) {
+		fprintf (stdout, "  -> the event loop is saturated, it cannot keep up with %u streams.\n", n_io);
+	}
+}
+
+static void print_process_stats (const AlsaIO* io)
+{
+	unsigned int p;
+	const double period_us = 1e6 * io->samples_per_period / io->samplerate;
+
+	fprintf (stdout, "channel processing: %u channels, dsp-load %u, period %.1f us\n",
+			io->n_bufs, io->dsp_load, period_us);
+	fprintf (stdout, "  threads  work[us]  wall[us]  wall-max  overhead  ovh-max   load%%  speedup\n");
+	for (p = 0; p < io->n_phases; ++p) {
+		const PhaseStats* ps = &io->phase_stats[p];
+		if (ps->wall.count == 0) {
+			continue;
+		}
+		fprintf (stdout, "  %7u  %8.2f  %8.2f  %8.2f  %8.2f  %7.2f  %6.2f  %7.2f\n",
+				ps->threads,
+				rs_mean (&ps->work),
+				rs_mean (&ps->wall), ps->wall.max,
+				rs_mean (&ps->overhead), ps->overhead.max,
+				100. * rs_mean (&ps->wall) / period_us,
+				rs_mean (&ps->work) / rs_mean (&ps->wall));
+	}
+}
+
+/* one chunk of background work, roughly 10-100 usec */
+static void stress_chunk (Stressor* st)
+{
+	size_t i;
+	switch (st->kind) {
+		case STRESS_MEMBW:
+			{
+				/* stream through both halves of the buffer */
+				const size_t half = st->ctl->mem_size / 2;
+				const size_t off = (st->ops * STRESS_CHUNK) % half;
+				memcpy (st->mem + half + off, st->mem + off, STRESS_CHUNK);
+			}
+			break;
+		case STRESS_CACHE:
+			{
+				/* random read-modify-write, defeats caches and prefetchers */
+				uint64_t x = st->ops * 0x9e3779b97f4a7c15ULL + 1;
+				for (i = 0; i < 4096; ++i) {
+					x ^= x << 13;
+					x ^= x >> 7;
+					x ^= x << 17;
+					st->mem[x % st->ctl->mem_size] += 1;
+				}
+			}
+			break;
+		case STRESS_SYSCALL:
+			{
+				char path[96];
+				char buf[4096];
+				struct stat sb;
+				snprintf (path, sizeof (path), "%s/churn-%d", st->ctl->tmpdir, st->cpu);
+				const int fd = open (path, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0600);
+				if (fd >= 0) {
+					memset (buf, st->ops & 0xff, sizeof (buf));
+					if (write (fd, buf, sizeof (buf)) < 0 || pread (fd, buf, sizeof (buf), 0) < 0) {
+						/* ignore */
+					}
+					fstat (fd, &sb);
+					close (fd);
+				}
+				unlink (path);
+				sched_yield ();
+			}
+			break;
+		case STRESS_CPU:
+			{
+				volatile double acc = st->ops;
+				for (i = 0; i < 20000; ++i) {
+					acc = acc * 1.0000001 + 1e-9;
+				}
+			}
+			break;
+		default:
+			break;
+	}
+	++st->ops;
+}
+
+static void* stress_thread (void* arg)
+{
+	Stressor* st = arg;
+	StressCtl* ctl = st->ctl;
+	const uint64_t duty = (uint64_t) STRESS_SLICE * ctl->level / 100;
+
+	while (!__atomic_load_n (&ctl->quit, __ATOMIC_ACQUIRE)) {
+		if (__atomic_load_n (ctl->phase, __ATOMIC_ACQUIRE) != st->phase) {
+			usleep (5000);
+			continue;
+		}
+		const uint64_t t0 = now_ns ();
+		uint64_t t1;
+		while ((t1 = now_ns ()) - t0 < duty) {
+			stress_chunk (st);
+		}
+		st->busy += t1 - t0;
+		if (duty < STRESS_SLICE) {
+			usleep ((STRESS_SLICE - duty) / 1000);
+		}
+	}
+	return 0;
+}
+
+/* parse a comma separated list of stressor names */
+static int stress_parse (StressCtl* ctl, const char* list)
+{
+	char* tmp = strdup (list);
+	char* save = NULL;
+	char* tok;
+	int k;
+
+	ctl->n_kinds = 0;
+	for (tok = strtok_r (tmp, ",", &save); tok; tok = strtok_r (NULL, ",", &save)) {
+		if (!strcmp (tok, "all")) {
+			for (k = 0; k < N_STRESS; ++k) {
+				ctl->kinds[k] = (enum StressKind) k;
+			}
+			ctl->n_kinds = N_STRESS;
+			continue;
+		}
+		for (k = 0; k < N_STRESS; ++k) {
+			if (!strcmp (tok, stress_names[k])) {
+				break;
+			}
+		}
+		if (k == N_STRESS) {
+			fprintf (stderr, "unknown stressor '%s'.\n", tok);
+			free (tmp);
+			return -1;
+		}
+		if (ctl->n_kinds < N_STRESS) {
+			ctl->kinds[ctl->n_kinds++] = (enum StressKind) k;
+		}
+	}
+	free (tmp);
+	return ctl->n_kinds > 0 ? 0 : -1;
+}
+
+/* parse a CPU list, e.g. "1,2" or "1-3" */
+static int cpulist_parse (int* cpus, unsigned int* n_cpus, const char* list)
+{
+	const char* p = list;
+	*n_cpus = 0;
+	while (*p) {
+		char* end;
+		long a = strtol (p, &end, 10);
+		long b = a;
+		if (end == p || a < 0) {
+			return -1;
+		}
+		if (*end == '-') {
+			p = end + 1;
+			b = strtol (p, &end, 10);
+			if (end == p || b < a) {
+				return -1;
+			}
+		}
+		for (; a <= b && *n_cpus < CPU_SETSIZE; ++a) {
+			cpus[(*n_cpus)++] = a;
+		}
+		p = (*end == ',') ? end + 1 : end;
+		if (*end && *end != ',') {
+			return -1;
+		}
+	}
+	return *n_cpus > 0 ? 0 : -1;
+}
+
+/* start one non-realtime thread per stressor kind and CPU,
+ * stressor `k` is active in test phase `k + 1`. */
+static int stress_start (StressCtl* ctl, AlsaIO* io)
+{
+	unsigned int k, c;
+
+	ctl->phase = &io->phase;
+	if (ctl->n_cpus == 0) {
+		const int n_cpu = sysconf (_SC_NPROCESSORS_ONLN);
+		for (c = 0; c < (unsigned int) n_cpu && c < CPU_SETSIZE; ++c) {
+			ctl->cpus[c] = c;
+		}
+		ctl->n_cpus = c;
+	}
+
+	/* four times the last level cache, enough to miss it */
+	long llc = sysconf (_SC_LEVEL3_CACHE_SIZE);
+	if (llc <= 0) {
+		llc = sysconf (_SC_LEVEL2_CACHE_SIZE);
+	}
+	if (llc <= 0) {
+		llc = 2 << 20;
+	}
+	ctl->mem_size = ((size_t) llc * 4 + 2 * STRESS_CHUNK - 1) & ~((size_t) 2 * STRESS_CHUNK - 1);
+	if (ctl->mem_size > STRESS_MEM) {
+		ctl->mem_size = STRESS_MEM;
+	}
+
+	snprintf (ctl->tmpdir, sizeof (ctl->tmpdir), "/tmp/mod-alsa-test-XXXXXX");
+	if (!mkdtemp (ctl->tmpdir)) {
+		fprintf (stderr, "cannot create temporary directory: %s\n", strerror (errno));
+		return -1;
+	}
+
+	ctl->threads = (Stressor*) calloc (ctl->n_kinds * ctl->n_cpus, sizeof (Stressor));
+	if (!ctl->threads) {
+		fprintf (stderr, "cannot allocate stressors.\n");
+		return -1;
+	}
+
+	for (k = 0; k < ctl->n_kinds; ++k) {
+		for (c = 0; c < ctl->n_cpus; ++c) {
+			Stressor* st = &ctl->threads[ctl->n_threads];
+			st->ctl   = ctl;
+			st->kind  = ctl->kinds[k];
+			st->phase = k + 1;
+			st->cpu   = ctl->cpus[c];
+			if (st->kind == STRESS_MEMBW || st->kind == STRESS_CACHE) {
+				/* allocate and pre-fault before audio starts */
+				if (!(st->mem = (char*) malloc (ctl->mem_size))) {
+					fprintf (stderr, "cannot allocate %zu bytes for the %s stressor on CPU %d.\n",
+							ctl->mem_size, stress_names[st->kind], st->cpu);
+					return -1;
+				}
+				memset (st->mem, 0x55, ctl->mem_size);
+			}
+			if (pthread_create (&st->thread, NULL, stress_thread, st)) {
+				fprintf (stderr, "cannot create stressor thread.\n");
+				free (st->mem);
+				return -1;
+			}
+			pin_thread (st->thread, st->cpu);
+			++ctl->n_threads;
+		}
+	}
+	return 0;
+}
+
+/* join all stressors and release their memory, the counters stay
+ * valid for print_stress_stats () until stress_free () */
+static void stress_stop (StressCtl* ctl)
+{
+	__atomic_store_n (&ctl->quit, true, __ATOMIC_RELEASE);
+	for (; ctl->n_joined < ctl->n_threads; ++ctl->n_joined) {
+		Stressor* st = &ctl->threads[ctl->n_joined];
+		pthread_join (st->thread, NULL);
+		free (st->mem);
+		st->mem = NULL;
+	}
+	if (ctl->tmpdir[0]) {
+		rmdir (ctl->tmpdir);
+		ctl->tmpdir[0] = '\0';
+	}
+}
+
+static void stress_free (StressCtl* ctl)
+{
+	stress_stop (ctl);
+	free (ctl->threads);
+	ctl->threads   = NULL;
+	ctl->n_threads = 0;
+	ctl->n_joined  = 0;
+}
+
+static void print_stress_stats (const AlsaIO* io, const StressCtl* ctl)
+{
+	unsigned int p, i;
+	const PhaseStats* base = &io->phase_stats[0];
+	const double base_p99 = hist_percentile (&base->run.late, .99) * 1e-6;
+
+	fprintf (stdout, "interference: %u CPUs, %d%% duty cycle, %.0fs per phase\n", ctl->n_cpus, ctl->level, io->run_for);
+	fprintf (stdout, "  %-9s %9s %6s %9s %9s %9s %9s %9s %9s  %s\n",
+			"phase", "periods", "xruns", "late p50", "late p99", "p99.9", "late max", "proc p99", "proc max", "load");
+	for (p = 0; p < io->n_phases; ++p) {
+		const RunStats* rs = &io->phase_stats[p].run;
+		const char* name = p == 0 ? "baseline" : stress_names[ctl->kinds[p - 1]];
+		double secs = 0;
+		uint64_t ops = 0;
+
+		for (i = 0; i < ctl->n_threads; ++i) {
+			if (ctl->threads[i].phase == p) {
+				ops  += ctl->threads[i].ops;
+				secs += ctl->threads[i].busy * 1e-9;
+			}
+		}
+
+		fprintf (stdout, "  %-9s %9" PRIu64 " %6" PRIu64 " %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f",
+				name, rs->periods, rs->xruns,
+				hist_percentile (&rs->late, .5) * 1e-6,
+				hist_percentile (&rs->late, .99) * 1e-6,
+				hist_percentile (&rs->late, .999) * 1e-6,
+				rs->late.max * 1e-6,
+				hist_percentile (&rs->proc, .99) * 1e-6,
+				rs->proc.max * 1e-6);
+		if (p == 0 || secs <= 0) {
+			fprintf (stdout, "\n");
+			continue;
+		}
+
+		switch (ctl->kinds[p - 1]) {
+			case STRESS_MEMBW:
+				fprintf (stdout, "  %.0f MB/s", ops * (256 << 10) / secs / (1 << 20));
+				break;
+			case STRESS_CACHE:
+				fprintf (stdout, "  %.1f M access/s", ops * 4096. / secs * 1e-6);
+				break;
+			case STRESS_SYSCALL:
+				fprintf (stdout, "  %.0f files/s", ops / secs);
+				break;
+			default:
+				fprintf (stdout, "  %.0f ops/s", ops / secs);
+				break;
+		}
+		fprintf (stdout, " (late p99 %+.3f ms)\n", hist_percentile (&rs->late, .99) * 1e-6 - base_p99);
+	}
+}
+
+/* read a small /proc file, strip the trailing newline */
+static int file_read (const char* path, char* buf, size_t len)
+{
+	ssize_t n;
+	const int fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+	n = read (fd, buf, len - 1);
+	close (fd);
+	if (n < 0) {
+		return -1;
+	}
+	while (n > 0 && buf[n - 1] == '\n') {
+		--n;
+	}
+	buf[n] = '\0';
+	return n;
+}
+
+static int proc_read (pid_t tid, const char* file, char* buf, size_t len)
+{
+	char path[64];
+	snprintf (path, sizeof (path), "/proc/self/task/%d/%s", (int) tid, file);
+	return file_read (path, buf, len);
+}
+
+/* the kernel's view of a stream, independent of the alsa-lib handle
+ * which is owned by the process thread */
+static void watchdog_status_path (snd_pcm_t* handle, char* path, size_t len)
+{
+	snd_pcm_info_t* info;
+	snd_pcm_info_alloca (&info);
+	path[0] = '\0';
+	if (!handle || snd_pcm_info (handle, info) < 0 || snd_pcm_info_get_card (info) < 0) {
+		return;
+	}
+	snprintf (path, len, "/proc/asound/card%d/pcm%u%c/sub%u/status",
+			snd_pcm_info_get_card (info), snd_pcm_info_get_device (info),
+			snd_pcm_info_get_stream (info) == SND_PCM_STREAM_PLAYBACK ? 'p' : 'c',
+			snd_pcm_info_get_subdevice (info));
+}
+
+/* self-contained, the helper may outlive the stream */
+typedef struct {
+	char  name[64];
+	char  path[2][64];
+	bool  open[2];
+	int*  busy;
+} WatchdogStatus;
+
+/* a hung driver may hold the stream lock, reading the status can
+ * block. Do it from a detached helper, not from the watchdog loop. */
+static void* watchdog_status_thread (void* arg)
+{
+	WatchdogStatus* ws = arg;
+	char buf[1024];
+	int s;
+
+	for (s = 0; s < 2; ++s) {
+		const char* name = s == 0 ? "playback" : "capture";
+		char* save = NULL;
+		char* line;
+		if (!ws->open[s]) {
+			continue;
+		}
+		if (!ws->path[s][0] || file_read (ws->path[s], buf, sizeof (buf)) < 0) {
+			fprintf (stderr, "watchdog: %s: %s status unavailable\n", ws->name, name);
+			continue;
+		}
+		for (line = strtok_r (buf, "\n", &save); line; line = strtok_r (NULL, "\n", &save)) {
+			fprintf (stderr, "watchdog: %s: %s %s\n", ws->name, name, line);
+		}
+	}
+	__atomic_store_n (ws->busy, 0, __ATOMIC_RELEASE);
+	free (ws);
+	return 0;
+}
+
+static void watchdog_stream_status (Watchdog* wd, unsigned int i)
+{
+	pthread_t thread;
+	pthread_attr_t attr;
+	WatchdogStatus* ws;
+
+	/* at most one reader per stream, it may still be blocked */
+	if (__atomic_exchange_n (&wd->status_busy[i], 1, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+	if (!(ws = (WatchdogStatus*) malloc (sizeof (WatchdogStatus)))) {
+		__atomic_store_n (&wd->status_busy[i], 0, __ATOMIC_RELEASE);
+		return;
+	}
+	memcpy (ws->name, wd->ios[i]->name, sizeof (ws->name));
+	memcpy (ws->path, wd->proc_status[i], sizeof (ws->path));
+	ws->open[0] = wd->ios[i]->play_handle != NULL;
+	ws->open[1] = wd->ios[i]->capt_handle != NULL;
+	ws->busy    = &wd->status_busy[i];
+	pthread_attr_init (&attr);
+	pthread_attr_setdetachstate (&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create (&thread, &attr, watchdog_status_thread, ws)) {
+		__atomic_store_n (&wd->status_busy[i], 0, __ATOMIC_RELEASE);
+		free (ws);
+	}
+	pthread_attr_destroy (&attr);
+}
+
+/* dump the state of a stalled process thread */
+static void watchdog_dump (Watchdog* wd, unsigned int i, pid_t tid, uint64_t dt, uint64_t heartbeat)
+{
+	AlsaIO* io = wd->ios[i];
+	char buf[4096];
+	const char* state = "?";
+
+	tmark (io, MARK_STALL);
+	fprintf (stderr, "watchdog: %s: no period for %.2f ms after %" PRIu64 " periods (tid %d)\n",
+			io->name, dt * 1e-6, heartbeat, (int) tid);
+
+	if (proc_read (tid, "stat", buf, sizeof (buf)) > 0) {
+		/* state follows the parenthesized command name */
+		char* p = strrchr (buf, ')');
+		if (p && p[1] == ' ' && p[2]) {
+			p[3] = '\0';
+			state = p + 2;
+		}
+	}
+	fprintf (stderr, "  task state: %s\n", state);
+	if (proc_read (tid, "wchan", buf, sizeof (buf)) >= 0) {
+		fprintf (stderr, "  wchan: %s\n", buf[0] ? buf : "0");
+	}
+	if (proc_read (tid, "syscall", buf, sizeof (buf)) > 0) {
+		fprintf (stderr, "  syscall: %s\n", buf);
+	}
+	if (proc_read (tid, "stack", buf, sizeof (buf)) > 0) {
+		char* save = NULL;
+		char* line;
+		for (line = strtok_r (buf, "\n", &save); line; line = strtok_r (NULL, "\n", &save)) {
+			fprintf (stderr, "  stack: %s\n", line);
+		}
+	} else {
+		fprintf (stderr, "  stack: unavailable (%s)\n", strerror (errno));
+	}
+
+	watchdog_stream_status (wd, i);
+}
+
+static void* watchdog_thread (void* arg)
+{
+	Watchdog* wd = arg;
+	const AlsaIO* io0 = wd->ios[0];
+	const uint64_t limit = 1000000000ULL * io0->samples_per_period * wd->threshold / io0->samplerate;
+	uint64_t interval = limit / 4;
+	uint64_t seen[MAX_STREAMS];
+	uint64_t t_seen[MAX_STREAMS];
+	bool stalled[MAX_STREAMS];
+	unsigned int i;
+
+	if (interval < 500000) {
+		interval = 500000;
+	}
+	memset (seen, 0, sizeof (seen));
+	memset (stalled, 0, sizeof (stalled));
+	for (i = 0; i < wd->n_io; ++i) {
+		t_seen[i] = now_ns ();
+	}
+
+	while (!__atomic_load_n (&wd->quit, __ATOMIC_ACQUIRE)) {
+		struct timespec ts;
+		ts.tv_sec  = interval / 1000000000ULL;
+		ts.tv_nsec = interval % 1000000000ULL;
+		clock_nanosleep (CLOCK_MONOTONIC, 0, &ts, NULL);
+
+		const uint64_t now = now_ns ();
+		for (i = 0; i < wd->n_io; ++i) {
+			AlsaIO* io = wd->ios[i];
+			const pid_t tid = __atomic_load_n (&io->rt_tid, __ATOMIC_ACQUIRE);
+			const uint64_t hb = __atomic_load_n (&io->heartbeat, __ATOMIC_RELAXED);
+
+			if (hb != seen[i] || !tid || __atomic_load_n (&io->thread_done, __ATOMIC_ACQUIRE)) {
+				if (stalled[i]) {
+					const uint64_t dt = now - t_seen[i];
+					rs_add (&wd->stall, dt * 1e-6);
+					if (dt > wd->max_stall) {
+						wd->max_stall = dt;
+					}
+					fprintf (stderr, "watchdog: %s: resumed after %.2f ms\n", io->name, dt * 1e-6);
+				}
+				seen[i]    = hb;
+				t_seen[i]  = now;
+				stalled[i] = false;
+				continue;
+			}
+			if (!stalled[i] && now - t_seen[i] > limit) {
+				stalled[i] = true;
+				++wd->stalls;
+				watchdog_dump (wd, i, tid, now - t_seen[i], hb);
+			}
+		}
+	}
+
+	/* stalls which lasted until the end */
+	for (i = 0; i < wd->n_io; ++i) {
+		if (stalled[i]) {
+			const uint64_t dt = now_ns () - t_seen[i];
+			rs_add (&wd->stall, dt * 1e-6);
+			if (dt > wd->max_stall) {
+				wd->max_stall = dt;
+			}
+		}
+	}
+	return 0;
+}
+
+/* the watchdog runs one priority step above the process thread(s) */
+static int watchdog_start (Watchdog* wd, AlsaIO** ios, unsigned int n_io, int rt_priority)
+{
+	int err;
+	unsigned int i;
+	wd->ios  = ios;
+	wd->n_io = n_io;
+	rs_reset (&wd->stall);
+	for (i = 0; i < n_io; ++i) {
+		watchdog_status_path (ios[i]->play_handle, wd->proc_status[i][0], sizeof (wd->proc_status[i][0]));
+		watchdog_status_path (ios[i]->capt_handle, wd->proc_status[i][1], sizeof (wd->proc_status[i][1]));
+	}
+	if (rt_priority < 0) {
+		err = realtime_pthread_create (SCHED_FIFO, rt_priority + 1, 100000, &wd->thread, watchdog_thread, wd);
+	} else {
+		err = pthread_create (&wd->thread, NULL, watchdog_thread, wd);
+	}
+	if (err) {
+		fprintf (stderr, "cannot create watchdog thread.\n");
+		wd->ios = NULL;
+		return -1;
+	}
+	wd->running = true;
+	return 0;
+}
+
+static void watchdog_stop (Watchdog* wd)
+{
+	if (!wd->running) {
+		return;
+	}
+	__atomic_store_n (&wd->quit, true, __ATOMIC_RELEASE);
+	pthread_join (wd->thread, NULL);
+	wd->running = false;
+}
+
+static void print_watchdog_stats (const Watchdog* wd)
+{
+	const AlsaIO* io0 = wd->ios[0];
+	fprintf (stdout, "watchdog: %" PRIu64 " stalls > %u periods (%.2f ms)",
+			wd->stalls, wd->threshold, 1e3 * io0->samples_per_period * wd->threshold / io0->samplerate);
+	if (wd->stall.count > 0) {
+		fprintf (stdout, ", duration avg: %.2f ms, max: %.2f ms", rs_mean (&wd->stall), wd->max_stall * 1e-6);
+	}
+	fprintf (stdout, "\n");
+}
+
+/* regression gate, results of the primary stream */
+enum BaselineKey {
+	BL_RATE = 0,
+	BL_PERIOD,
+	BL_PLAY_PERIODS,
+	BL_CAPT_PERIODS,
+	BL_PERIODS,
+	BL_XRUNS,
+	BL_WAKE_P50,      /* wakeup lateness */
+	BL_WAKE_P99,
+	BL_WAKE_P999,
+	BL_WAKE_MAX,
+	BL_PROC_P50,
+	BL_PROC_P99,
+	BL_PROC_P999,
+	BL_PROC_MAX,
+	BL_RECOVER_P50,
+	BL_RECOVER_MAX,
+	BL_WAIT_CALLS,    /* per period, compare engines */
+	BL_CTXSW,
+	N_BASELINE
+};
+
+#define BL_N_CONFIG BL_PERIODS /* settings, not compared */
+
+static const char* baseline_keys[N_BASELINE] = {
+	"samplerate",
+	"period",
+	"play_periods",
+	"capt_periods",
+	"periods",
+	"xruns",
+	"wake_late_p50_ms",
+	"wake_late_p99_ms",
+	"wake_late_p999_ms",
+	"wake_late_max_ms",
+	"proc_p50_ms",
+	"proc_p99_ms",
+	"proc_p999_ms",
+	"proc_max_ms",
+	"recover_p50_ms",
+	"recover_max_ms",
+	"wait_per_period",
+	"ctxsw_per_period",
+};
+
+static void baseline_collect (const AlsaIO* io, double* v)
+{
+	const RunStats* rs = &io->stats;
+	v[BL_RATE]         = io->samplerate;
+	v[BL_PERIOD]       = io->samples_per_period;
+	v[BL_PLAY_PERIODS] = io->play_periods_per_cycle;
+	v[BL_CAPT_PERIODS] = io->capt_periods_per_cycle;
+	v[BL_PERIODS]      = rs->periods;
+	v[BL_XRUNS]        = rs->xruns;
+	v[BL_WAKE_P50]     = hist_percentile (&rs->late, .5) * 1e-6;
+	v[BL_WAKE_P99]     = hist_percentile (&rs->late, .99) * 1e-6;
+	v[BL_WAKE_P999]    = hist_percentile (&rs->late, .999) * 1e-6;
+	v[BL_WAKE_MAX]     = rs->late.max * 1e-6;
+	v[BL_PROC_P50]     = hist_percentile (&rs->proc, .5) * 1e-6;
+	v[BL_PROC_P99]     = hist_percentile (&rs->proc, .99) * 1e-6;
+	v[BL_PROC_P999]    = hist_percentile (&rs->proc, .999) * 1e-6;
+	v[BL_PROC_MAX]     = rs->proc.max * 1e-6;
+	v[BL_RECOVER_P50]  = hist_percentile (&rs->recover, .5) * 1e-6;
+	v[BL_RECOVER_MAX]  = rs->recover.max * 1e-6;
+	v[BL_WAIT_CALLS]   = rs->periods > 0 ? (double) io->wait_calls / rs->periods : 0;
+	v[BL_CTXSW]        = rs->periods > 0 ? (double) io->ctxsw / rs->periods : 0;
+}
+
+static int baseline_save (const AlsaIO* io, const char* path)
+{
+	double v[N_BASELINE];
+	int k;
+	FILE* f = fopen (path, "w");
+	if (!f) {
+		fprintf (stderr, "cannot write baseline '%s': %s\n", path, strerror (errno));
+		return -1;
+	}
+	baseline_collect (io, v);
+	fprintf (f, "# mod-alsa-test %s baseline, %s, %.1fs, engine %s\n", VERSION, io->name, (io->stats.t_end - io->stats.t_start) * 1e-9,
+			io->engine == ENGINE_URING ? "io_uring" : "ppoll");
+	for (k = 0; k < N_BASELINE; ++k) {
+		fprintf (f, "%s %.6f\n", baseline_keys[k], v[k]);
+	}
+	fclose (f);
+	return 0;
+}
+
+static int baseline_load (const char* path, double* v, bool* have)
+{
+	char line[256];
+	char key[64];
+	double val;
+	int k;
+	FILE* f = fopen (path, "r");
+	if (!f) {
+		fprintf (stderr, "cannot read baseline '%s': %s\n", path, strerror (errno));
+		return -1;
+	}
+	memset (have, 0, N_BASELINE * sizeof (bool));
+	while (fgets (line, sizeof (line), f)) {
+		if (line[0] == '#' || sscanf (line, "%63s %lf", key, &val) != 2) {
+			continue;
+		}
+		for (k = 0; k < N_BASELINE; ++k) {
+			if (!strcmp (key, baseline_keys[k])) {
+				v[k] = val;
+				have[k] = true;
+			}
+		}
+	}
+	fclose (f);
+	return 0;
+}
+
+/* a metric regresses if it exceeds `base * (1 + tol_rel) + tol_abs`,
+ * the x-run count is scaled by the number of periods. Counts are not
+ * times, they only get the relative tolerance.
+ * Returns the number of regressions, -1 if the baseline cannot be read. */
+static int baseline_compare (const AlsaIO* io, const char* path, double tol_rel, double tol_abs)
+{
+	double base[N_BASELINE];
+	double cur[N_BASELINE];
+	bool have[N_BASELINE];
+	int k;
+	int n_fail = 0;
+
+	if (baseline_load (path, base, have)) {
+		return -1;
+	}
+	baseline_collect (io, cur);
+
+	for (k = 0; k < BL_N_CONFIG; ++k) {
+		if (have[k] && base[k] != cur[k]) {
+			fprintf (stderr, "baseline: %s differs (%g, now %g), results may not be comparable.\n",
+					baseline_keys[k], base[k], cur[k]);
+		}
+	}
+
+	fprintf (stdout, "baseline: %s (tolerance %.0f%% + %.3f ms)\n", path, tol_rel * 100, tol_abs);
+	fprintf (stdout, "  %-16s %12s %12s %12s\n", "metric", "baseline", "current", "limit");
+	for (k = BL_XRUNS; k < N_BASELINE; ++k) {
+		double limit;
+		if (!have[k]) {
+			continue;
+		}
+		if (k == BL_XRUNS) {
+			const double scale = (have[BL_PERIODS] && base[BL_PERIODS] > 0) ? cur[BL_PERIODS] / base[BL_PERIODS] : 1;
+			limit = ceil (base[k] * scale * (1 + tol_rel));
+		} else if ((k == BL_RECOVER_P50 || k == BL_RECOVER_MAX) && (base[BL_XRUNS] == 0 || cur[BL_XRUNS] == 0)) {
+			/* nothing to compare, x-runs are gated above */
+			continue;
+		} else if (k >= BL_WAIT_CALLS && (base[k] == 0 || cur[k] == 0)) {
+			/* not counted by the multi-device event loop */
+			continue;
+		} else if (k >= BL_WAIT_CALLS) {
+			limit = base[k] * (1 + tol_rel);
+		} else {
+			limit = base[k] * (1 + tol_rel) + tol_abs;
+		}
+		const bool fail = cur[k] > limit;
+		fprintf (stdout, "  %-16s %12.3f %12.3f %12.3f%s\n", baseline_keys[k], base[k], cur[k], limit, fail ? "  REGRESSION" : "");
+		if (fail) {
+			++n_fail;
+		}
+	}
+	fprintf (stdout, "baseline: %s\n", n_fail ? "FAIL" : "PASS");
+	return n_fail;
+}
+
+static void alsa_close (AlsaIO* io)
+{
+	unsigned int i;
+	const uint64_t t0 = now_ns ();
+
+	if (io->play_handle) {
+		snd_pcm_close (io->play_handle);
+		io->play_handle = NULL;
+	}
+	if (io->capt_handle) {
+		snd_pcm_close (io->capt_handle);
+		io->capt_handle = NULL;
+	}
+	io->startup.close = now_ns () - t0;
+
+	if (io->testbuffers) {
+		for (i = 0; i < io->n_bufs; i++) {
+			free (io->testbuffers[i]);
+			free (io->scratch[i]);
+		}
+		free (io->testbuffers);
+		free (io->scratch);
+		free (io->chan);
+		io->testbuffers = NULL;
+		io->scratch = NULL;
+		io->chan = NULL;
+	}
+	free (io->play_ptr);
+	free ((void*) io->capt_ptr);
+	free (io->dl);
+	free (io->dq);
+	io->play_ptr = NULL;
+	io->capt_ptr = NULL;
+	io->dl = NULL;
+	io->dq = NULL;
+	io->dither_scale = 0;
+	io->n_bufs = 0;
+}
+
+static void alloc_buffers (AlsaIO* io)
+{
+	unsigned int i;
+	io->n_bufs = io->play_nchan > io->capt_nchan ? io->play_nchan : io->capt_nchan;
+	io->testbuffers = (float**) calloc (io->n_bufs, sizeof (float*));
+	io->scratch     = (float**) calloc (io->n_bufs, sizeof (float*));
+	if (posix_memalign ((void**) &io->chan, 64, io->n_bufs * sizeof (ChanState))) {
+		io->chan = NULL;
+	} else {
+		memset (io->chan, 0, io->n_bufs * sizeof (ChanState));
+	}
+	io->play_ptr    = (char**) calloc (io->play_nchan + 1, sizeof (char*));
+	io->capt_ptr    = (const char**) calloc (io->capt_nchan + 1, sizeof (char*));
+
+	for (i = 0; i < io->n_bufs; ++i) {
+		io->testbuffers[i] = (float*) calloc (io->samples_per_period, sizeof (float));
+		io->scratch[i]     = (float*) calloc (io->samples_per_period, sizeof (float));
+	}
+}
+
+static int alsa_open (AlsaIO* io, const char* play_device, const char* capt_device, bool sync, bool verbose)
+{
+	uint64_t t0;
+	int rv = -1;
+	snd_pcm_hw_params_t* play_hwpar = NULL;
+	snd_pcm_sw_params_t* play_swpar = NULL;
+	snd_pcm_hw_params_t* capt_hwpar = NULL;
+	snd_pcm_sw_params_t* capt_swpar = NULL;
+
+	snd_pcm_format_t play_format;
+	snd_pcm_format_t capt_format;
+	snd_pcm_access_t play_access;
+	snd_pcm_access_t capt_access;
+
+	memset (&io->startup, 0, sizeof (StartupTiming));
+
+	if (play_device && capt_device && strcmp (play_device, capt_device)) {
+		snprintf (io->name, sizeof (io->name), "%s/%s", play_device, capt_device);
+	} else {
+		snprintf (io->name, sizeof (io->name), "%s", play_device ? play_device : capt_device);
+	}
+
+	/* a NULL device leaves that direction disabled */
+	t0 = now_ns ();
+	if (play_device && snd_pcm_open (&io->play_handle, play_device, SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+		fprintf (stderr, "cannot open playback device '%s'\n", play_device);
+	}
+	if (capt_device && snd_pcm_open (&io->capt_handle, capt_device, SND_PCM_STREAM_CAPTURE, 0) < 0) {
+		fprintf (stderr, "cannot open capture device '%s'\n", capt_device);
+	}
+	io->startup.open = now_ns () - t0;
+
+	if (!io->play_handle && !io->capt_handle) {
+		fprintf (stderr, "no capture and no playback device.\n");
+		goto out;
+	}
+
+	if (snd_pcm_hw_params_malloc (&play_hwpar) < 0) {
+		fprintf (stderr, "cannot allocate playback hw params\n");
+		goto out;
+	}
+	if (snd_pcm_sw_params_malloc (&play_swpar) < 0) {
+		fprintf (stderr, "cannot allocate playback sw params\n");
+		goto out;
+	}
+	if (snd_pcm_hw_params_malloc (&capt_hwpar) < 0) {
+		fprintf (stderr, "cannot allocate capture hw params\n");
+		goto out;
+	}
+	if (snd_pcm_sw_params_malloc (&capt_swpar) < 0) {
+		fprintf (stderr, "cannot allocate capture sw params\n");
+		goto out;
+	}
+
+	io->synced = false;
+	/* setup */
+	if (io->play_handle) {
+		t0 = now_ns ();
+		if (set_hwpar (io, play_hwpar, true) < 0) {
+			goto out;
+		}
+		io->startup.hwpar += now_ns () - t0;
+		t0 = now_ns ();
+		if (set_swpar (io, play_swpar, true) < 0) {
+			goto out;
+		}
+		io->startup.swpar += now_ns () - t0;
+		io->play_npfd = snd_pcm_poll_descriptors_count (io->play_handle);
+	}
+
+	if (io->capt_handle) {
+		t0 = now_ns ();
+		if (set_hwpar (io, capt_hwpar, false) < 0) {
+			goto out;
+		}
+		io->startup.hwpar += now_ns () - t0;
+		t0 = now_ns ();
+		if (set_swpar (io, capt_swpar, false) < 0) {
+			goto out;
+		}
+		io->startup.swpar += now_ns () - t0;
+		io->capt_npfd = snd_pcm_poll_descriptors_count (io->capt_handle);
+
+		if (io->play_handle && sync) {
+			t0 = now_ns ();
+			io->synced = ! snd_pcm_link (io->play_handle, io->capt_handle);
+			io->startup.link = now_ns () - t0;
+		}
+	}
+
+	/* verify settings */
+	if (io->play_handle) {
+		int dir;
+		unsigned int val;
+		snd_pcm_uframes_t fc;
+		if (snd_pcm_hw_params_get_rate (play_hwpar, &val, &dir) || (val != io->samplerate) || dir) {
+			fprintf (stderr, "cannot get requested sample rate for playback.\n");
+			goto out;
+		}
+		if (snd_pcm_hw_params_get_period_size (play_hwpar, &fc, &dir) || (fc != io->samples_per_period) || dir) {
+			fprintf (stderr, "cannot get requested period size for playback.\n");
+			goto out;
+		}
+		if (snd_pcm_hw_params_get_periods (play_hwpar, &val, &dir) || (val != io->play_periods_per_cycle) || dir)
+		{
+			fprintf (stderr, "cannot get requested number of periods for playback.\n");
+			goto out;
+		}
+	}
+
+	if (io->capt_handle) {
+		int dir;
+		unsigned int val;
+		snd_pcm_uframes_t fc;
+		if (snd_pcm_hw_params_get_rate (capt_hwpar, &val, &dir) || (val != io->samplerate) || dir) {
+			fprintf (stderr, "cannot get requested sample rate for capture.\n");
+			goto out;
+		}
+		if (snd_pcm_hw_params_get_period_size (capt_hwpar, &fc, &dir) || (fc != io->samples_per_period) || dir) {
+			fprintf (stderr, "cannot get requested period size for capture.\n");
+			goto out;
+		}
+		if (snd_pcm_hw_params_get_periods (capt_hwpar, &val, &dir) || (val != io->capt_periods_per_cycle) || dir)
+		{
+			fprintf (stderr, "cannot get requested number of periods for capture.\n");
+			goto out;
+		}
+	}
+
+	if (io->play_handle) {
+		snd_pcm_hw_params_get_format (play_hwpar, &play_format);
+		snd_pcm_hw_params_get_access (play_hwpar, &play_access);
+		io->play_format = play_format;
+
+		switch (play_format) {
+			case SND_PCM_FORMAT_FLOAT_LE:
+			case SND_PCM_FORMAT_S32_LE:
+			case SND_PCM_FORMAT_S32_BE:
+			case SND_PCM_FORMAT_S24_LE:
+			case SND_PCM_FORMAT_S24_BE:
+				io->play_bytes_per_sample = 4;
+				break;
+			case SND_PCM_FORMAT_S24_3LE:
+			case SND_PCM_FORMAT_S24_3BE:
+				io->play_bytes_per_sample = 3;
+				break;
+			case SND_PCM_FORMAT_S16_LE:
+			case SND_PCM_FORMAT_S16_BE:
+				io->play_bytes_per_sample = 2;
+				break;
+			default:
+				fprintf (stderr, "Cannot handle playback sample format.\n");
+				goto out;
+		}
+	}
+
+	if (io->capt_handle) {
+		snd_pcm_hw_params_get_format (capt_hwpar, &capt_format);
+		snd_pcm_hw_params_get_access (capt_hwpar, &capt_access);
+		io->capt_format = capt_format;
+
+		switch (capt_format) {
+			case SND_PCM_FORMAT_FLOAT_LE:
+			case SND_PCM_FORMAT_S32_LE:
+			case SND_PCM_FORMAT_S32_BE:
+			case SND_PCM_FORMAT_S24_LE:
+			case SND_PCM_FORMAT_S24_BE:
+				io->capt_bytes_per_sample = 4;
+				break;
+			case SND_PCM_FORMAT_S24_3LE:
+			case SND_PCM_FORMAT_S24_3BE:
+				io->capt_bytes_per_sample = 3;
+				break;
+			case SND_PCM_FORMAT_S16_LE:
+			case SND_PCM_FORMAT_S16_BE:
+				io->capt_bytes_per_sample = 2;
+				break;
+			default:
+				fprintf (stderr, "Cannot handle capture sample format.\n");
+				goto out;
+		}
+	}
+
+	if (!io->play_handle) {
+		io->play_nchan = 0;
+	}
+	if (!io->capt_handle) {
+		io->capt_nchan = 0;
+	}
+
+	if (verbose) {
+		fprintf (stdout, "device:   %s\n", io->name);
+		fprintf (stdout, "playback: ");
+		if (io->play_handle) {
+			fprintf (stdout, "\n");
+			fprintf (stdout, "  channels   : %d\n",  io->play_nchan);
+			fprintf (stdout, "  samplerate : %d\n",  io->samplerate);
+			fprintf (stdout, "  buffersize : %ld\n", io->samples_per_period);
+			fprintf (stdout, "  periods    : %d\n",  io->play_periods_per_cycle);
+			fprintf (stdout, "  format     : %s\n",  snd_pcm_format_name (play_format));
+		} else {
+			fprintf (stdout, " not enabled\n");
+		}
+		fprintf (stdout, "capture:  ");
+		if (io->capt_handle) {
+			fprintf (stdout, "\n");
+			fprintf (stdout, "  channels   : %d\n",  io->capt_nchan);
+			fprintf (stdout, "  samplerate : %d\n",  io->samplerate);
+			fprintf (stdout, "  buffersize : %ld\n", io->samples_per_period);
+			fprintf (stdout, "  periods    : %d\n",  io->capt_periods_per_cycle);
+			fprintf (stdout, "  format     : %s\n",  snd_pcm_format_name (capt_format));
+			if (io->play_handle) {
+				fprintf (stdout, "%s\n", io->synced ? "synced" : "not synced");
+			}
+		} else {
+			fprintf (stdout, " not enabled\n");
+		}
+	}
+
+	alloc_buffers (io);
+
+	if (dither_setup (io)) {
+		fprintf (stderr, "cannot allocate dither state.\n");
+		goto out;
+	}
+	if (io->dither != DITHER_NONE && io->dither_scale == 0 && verbose) {
+		fprintf (stdout, "dither: not applicable to %s.\n", snd_pcm_format_name (io->play_format));
+	}
+
+	rv = 0;
+
+out:
+	snd_pcm_sw_params_free (capt_swpar);
+	snd_pcm_hw_params_free (capt_hwpar);
+	snd_pcm_sw_params_free (play_swpar);
+	snd_pcm_hw_params_free (play_hwpar);
+
+	return rv;
+}
+
+static int start_rt_thread (int rt_priority, pthread_t* thread, void *(*start_routine) (void *), void* arg)
+{
+	if (rt_priority < 0) {
+		return realtime_pthread_create (SCHED_FIFO, rt_priority, 100000, thread, start_routine, arg);
+	} else {
+		return pthread_create (thread, NULL, start_routine, arg);
+	}
+}
+
+static int start_process_thread (AlsaIO* io, int rt_priority, pthread_t* thread)
+{
+	int err;
+	const uint64_t t0 = now_ns ();
+
+	err = start_rt_thread (rt_priority, thread, run_thread, io);
+	if (!err && io->pool.n_workers > 0) {
+		pin_thread (*thread, 0);
+	}
+
+	io->startup.thread = now_ns () - t0;
+	return err;
+}
+
+/* additional stream with the same settings as `master` */
+static AlsaIO* alsa_io_new (const AlsaIO* master, unsigned int play_nchan, unsigned int capt_nchan)
+{
+	AlsaIO* io = (AlsaIO*) calloc (1, sizeof (AlsaIO));
+	io->samplerate             = master->samplerate;
+	io->samples_per_period     = master->samples_per_period;
+	io->play_periods_per_cycle = master->play_periods_per_cycle;
+	io->capt_periods_per_cycle = master->capt_periods_per_cycle;
+	io->play_nchan             = play_nchan;
+	io->capt_nchan             = capt_nchan;
+	io->run_for                = master->run_for;
+	io->debug                  = master->debug;
+	io->process                = master->process;
+	io->dsp_load               = master->dsp_load;
+	io->latency                = master->latency;
+	io->hwptr_stats            = master->hwptr_stats;
+	io->engine                 = master->engine;
+	io->sine_freq              = master->sine_freq;
+	io->sine_gain              = master->sine_gain;
+	io->dither                 = master->dither;
+	io->n_phases               = master->n_phases > 0 ? master->n_phases : 1;
+	io->phase_stats            = (PhaseStats*) calloc (io->n_phases, sizeof (PhaseStats));
+	io->marker_fd              = -1;
+	io->tracing_on_fd          = -1;
+	return io;
+}
+
+#define N_STARTUP_PHASES 9
+
+static void startup_phases (const StartupTiming* st, double* ms)
+{
+	ms[0] = st->open * 1e-6;
+	ms[1] = st->hwpar * 1e-6;
+	ms[2] = st->swpar * 1e-6;
+	ms[3] = st->link * 1e-6;
+	ms[4] = st->prefill * 1e-6;
+	ms[5] = st->start * 1e-6;
+	ms[6] = st->thread * 1e-6;
+	ms[7] = st->first_period * 1e-6;
+	ms[8] = st->close * 1e-6;
+}
+
+static const char* startup_phase_names[N_STARTUP_PHASES] = {
+	"snd_pcm_open",
+	"set_hwpar",
+	"set_swpar",
+	"snd_pcm_link",
+	" prefill",
+	"pcm_start",
+	"thread create",
+	"first period",
+	"snd_pcm_close",
+};
+
+static void print_startup (const AlsaIO* io)
+{
+	int p;
+	double ms[N_STARTUP_PHASES];
+	startup_phases (&io->startup, ms);
+
+	fprintf (stdout, "startup timing [ms]:\n");
+	/* close is not part of the bring-up */
+	for (p = 0; p < N_STARTUP_PHASES - 1; ++p) {
+		fprintf (stdout, "  %-14s: %9.3f\n", startup_phase_names[p], ms[p]);
+	}
+	fprintf (stdout, "  (nominal period %.3f ms, first period is measured from pcm_start)\n",
+			1000.0 * io->samples_per_period / io->samplerate);
+}
+
+/* measure the time it takes to bring the device up and service the first period,
+ * repeated `cycles` times, full open/close each cycle. */
+static int startup_bench (AlsaIO* io, const char* play_device, const char* capt_device, bool sync, int rt_priority, int cycles)
+{
+	int n, p;
+	int rv = 0;
+	double ms[N_STARTUP_PHASES];
+	RunningStat stat[N_STARTUP_PHASES];
+	RunningStat total;
+
+	for (p = 0; p < N_STARTUP_PHASES; ++p) {
+		rs_reset (&stat[p]);
+	}
+	rs_reset (&total);
+
+	io->first_period_only = true;
+
+	for (n = 0; n < cycles && !signalled; ++n) {
+		pthread_t process_thread;
+		uint64_t t0, t_started;
+
+		t0 = now_ns ();
+		if (alsa_open (io, play_device, capt_device, sync, n == 0)) {
+			alsa_close (io);
+			rv = -1;
+			break;
+		}
+
+		io->t_first_period = 0;
+		t_started = now_ns ();
+		if (pcm_start (io)) {
+			alsa_close (io);
+			rv = -1;
+			break;
+		}
+		io->startup.start = now_ns () - t_started;
+		t_started += io->startup.start;
+
+		if (start_process_thread (io, rt_priority, &process_thread)) {
+			fprintf (stderr, "cannot create realtime process thread.\n");
+			pcm_stop (io);
+			alsa_close (io);
+			rv = -1;
+			break;
+		}
+		pthread_join (process_thread, NULL);
+
+		if (io->t_first_period) {
+			io->startup.first_period = io->t_first_period - t_started;
+			rs_add (&total, (io->t_first_period - t0) * 1e-6);
+		}
+
+		pcm_stop (io);
+		alsa_close (io);
+
+		startup_phases (&io->startup, ms);
+		for (p = 0; p < N_STARTUP_PHASES; ++p) {
+			rs_add (&stat[p], ms[p]);
+		}
+	}
+
+	io->first_period_only = false;
+
+	fprintf (stdout, "startup bench: %d cycles\n", n);
+	fprintf (stdout, "  %-14s  %9s %9s %9s %9s  [ms]\n", "phase", "min", "avg", "max", "stddev");
+	for (p = 0; p < N_STARTUP_PHASES; ++p) {
+		fprintf (stdout, "  %-14s: %9.3f %9.3f %9.3f %9.3f\n", startup_phase_names[p],
+				stat[p].min, rs_mean (&stat[p]), stat[p].max, rs_stddev (&stat[p]));
+	}
+	fprintf (stdout, "  %-14s: %9.3f %9.3f %9.3f %9.3f\n", "open to 1st",
+			total.min, rs_mean (&total), total.max, rs_stddev (&total));
+
+	return rv;
+}
+
+/* offline cost of the float to integer conversion, per period */
+static int dither_bench (const AlsaIO* master, int periods)
+{
+	static const snd_pcm_format_t formats[] = {
+		SND_PCM_FORMAT_S16_LE,
+		SND_PCM_FORMAT_S24_LE,
+		SND_PCM_FORMAT_S24_3LE,
+	};
+	static const char* modes[] = { "none", "tpdf", "shaped" };
+	const unsigned int nchan = master->play_nchan > 0 ? master->play_nchan : 2;
+	const snd_pcm_uframes_t len = master->samples_per_period;
+	unsigned int f, m, c;
+	int p;
+
+	fprintf (stdout, "dither benchmark: %u channels, %lu frames per period, %d periods\n", nchan, len, periods);
+	fprintf (stdout, "  %-10s %-7s %12s %12s\n", "format", "dither", "us/period", "ns/sample");
+
+	for (f = 0; f < sizeof (formats) / sizeof (formats[0]); ++f) {
+		for (m = DITHER_NONE; m <= DITHER_SHAPED; ++m) {
+			AlsaIO* io = alsa_io_new (master, nchan, 0);
+			io->play_format = formats[f];
+			io->play_bytes_per_sample = snd_pcm_format_physical_width (formats[f]) / 8;
+			io->play_step = nchan * io->play_bytes_per_sample;
+			io->dither = (enum DitherMode) m;
+			alloc_buffers (io);
+			if (dither_setup (io)) {
+				alsa_close (io);
+				free (io->phase_stats);
+				free (io);
+				return -1;
+			}
+
+			char* area = (char*) calloc (len, io->play_step);
+			for (c = 0; c < nchan; ++c) {
+				snd_pcm_uframes_t i;
+				io->play_ptr[c] = area + c * io->play_bytes_per_sample;
+				for (i = 0; i < len; ++i) {
+					io->testbuffers[c][i] = .5f * sinf (2 * M_PI * 997 * i / io->samplerate);
+				}
+			}
+
+			const uint64_t t0 = now_ns ();
+			for (p = 0; p < periods; ++p) {
+				if (io->dither_scale > 0) {
+					dither_period (io);
+				} else {
+					for (c = 0; c < nchan; ++c) {
+						write_chan (io->play_format, io->play_ptr[c], io->play_step, io->testbuffers[c], len);
+					}
+				}
+			}
+			const double dt = now_ns () - t0;
+
+			fprintf (stdout, "  %-10s %-7s %12.3f %12.3f\n",
+					snd_pcm_format_name (formats[f]), modes[m],
+					dt * 1e-3 / periods, dt / ((double) periods * len * nchan));
+
+			free (area);
+			alsa_close (io);
+			free (io->phase_stats);
+			free (io);
+		}
+	}
+	return 0;
+}
+
+/* capability probe, one job per card/device, both directions */
+
+static const unsigned int probe_rates[] = {
+	8000, 11025, 16000, 22050, 32000, 44100, 48000, 64000,
+	88200, 96000, 176400, 192000, 352800, 384000, 705600, 768000
+};
+#define N_PROBE_RATES (sizeof (probe_rates) / sizeof (unsigned int))
+
+typedef struct {
+	int               err;
+	bool              formats[SND_PCM_FORMAT_LAST + 1];
+	bool              access[SND_PCM_ACCESS_LAST + 1];
+	bool              rates[N_PROBE_RATES];
+	unsigned int      rate_min, rate_max;
+	unsigned int      chan_min, chan_max;
+	unsigned int      periods_min, periods_max;
+	snd_pcm_uframes_t period_min, period_max;
+	snd_pcm_uframes_t buffer_min, buffer_max;
+	bool              sync_start;
+	bool              joint_duplex;
+	bool              batch;
+} ProbeStream;
+
+typedef struct {
+	int         card;
+	int         device;
+	char        card_id[32];
+	char        card_name[80];
+	char        name[80];
+	bool        has[2];
+	ProbeStream stream[2];
+	int         link; /* 1: ok, 0: failed, -1: not tested */
+	double      probe_ms;
+} ProbeDevice;
+
+typedef struct {
+	ProbeDevice* dev;
+	unsigned int n_dev;
+	unsigned int next;
+} ProbeQueue;
+
+static int probe_stream (snd_pcm_t* handle, ProbeStream* ps)
+{
+	int err;
+	int dir;
+	unsigned int i;
+	snd_pcm_hw_params_t*   hwpar;
+	snd_pcm_format_mask_t* fmask;
+	snd_pcm_access_mask_t* amask;
+
+	snd_pcm_hw_params_alloca (&hwpar);
+	snd_pcm_format_mask_alloca (&fmask);
+	snd_pcm_access_mask_alloca (&amask);
+
+	if ((err = snd_pcm_hw_params_any (handle, hwpar)) < 0) {
+		return err;
+	}
+
+	snd_pcm_hw_params_get_format_mask (hwpar, fmask);
+	for (i = 0; i <= SND_PCM_FORMAT_LAST; ++i) {
+		ps->formats[i] = snd_pcm_format_mask_test (fmask, (snd_pcm_format_t) i);
+	}
+	snd_pcm_hw_params_get_access_mask (hwpar, amask);
+	for (i = 0; i <= SND_PCM_ACCESS_LAST; ++i) {
+		ps->access[i] = snd_pcm_access_mask_test (amask, (snd_pcm_access_t) i);
+	}
+	for (i = 0; i < N_PROBE_RATES; ++i) {
+		ps->rates[i] = 0 == snd_pcm_hw_params_test_rate (handle, hwpar, probe_rates[i], 0);
+	}
+
+	snd_pcm_hw_params_get_rate_min (hwpar, &ps->rate_min, &dir);
+	snd_pcm_hw_params_get_rate_max (hwpar, &ps->rate_max, &dir);
+	snd_pcm_hw_params_get_channels_min (hwpar, &ps->chan_min);
+	snd_pcm_hw_params_get_channels_max (hwpar, &ps->chan_max);
+	snd_pcm_hw_params_get_period_size_min (hwpar, &ps->period_min, &dir);
+	snd_pcm_hw_params_get_period_size_max (hwpar, &ps->period_max, &dir);
+	snd_pcm_hw_params_get_periods_min (hwpar, &ps->periods_min, &dir);
+	snd_pcm_hw_params_get_periods_max (hwpar, &ps->periods_max, &dir);
+	snd_pcm_hw_params_get_buffer_size_min (hwpar, &ps->buffer_min);
+	snd_pcm_hw_params_get_buffer_size_max (hwpar, &ps->buffer_max);
+
+	ps->sync_start   = snd_pcm_hw_params_can_sync_start (hwpar);
+	ps->joint_duplex = snd_pcm_hw_params_is_joint_duplex (hwpar);
+	ps->batch        = snd_pcm_hw_params_is_batch (hwpar);
+
+	return 0;
+}
+
+/* linking needs both streams out of the OPEN state,
+ * install the first configuration the device offers */
+static int probe_configure (snd_pcm_t* handle)
+{
+	int err;
+	unsigned int rate = 48000;
+	snd_pcm_access_t access;
+	snd_pcm_format_t format;
+	unsigned int     nchan;
+	snd_pcm_hw_params_t* hwpar;
+
+	snd_pcm_hw_params_alloca (&hwpar);
+
+	if ((err = snd_pcm_hw_params_any (handle, hwpar)) < 0
+			|| (err = snd_pcm_hw_params_set_access_first (handle, hwpar, &access)) < 0
+			|| (err = snd_pcm_hw_params_set_format_first (handle, hwpar, &format)) < 0
+			|| (err = snd_pcm_hw_params_set_channels_first (handle, hwpar, &nchan)) < 0
+			|| (err = snd_pcm_hw_params_set_rate_near (handle, hwpar, &rate, 0)) < 0) {
+		return err;
+	}
+	return snd_pcm_hw_params (handle, hwpar);
+}
+
+static void probe_device (ProbeDevice* pd)
+{
+	int s;
+	char name[32];
+	snd_pcm_t* handle[2] = { NULL, NULL };
+	const uint64_t t0 = now_ns ();
+
+	snprintf (name, sizeof (name), "hw:%d,%d", pd->card, pd->device);
+
+	for (s = 0; s < 2; ++s) {
+		if (!pd->has[s]) {
+			continue;
+		}
+		/* non-blocking open, a busy device must not stall the probe */
+		if ((pd->stream[s].err = snd_pcm_open (&handle[s], name, (snd_pcm_stream_t) s, SND_PCM_NONBLOCK)) < 0) {
+			handle[s] = NULL;
+			continue;
+		}
+		pd->stream[s].err = probe_stream (handle[s], &pd->stream[s]);
+	}
+
+	pd->link = -1;
+	if (handle[0] && handle[1] && !probe_configure (handle[0]) && !probe_configure (handle[1])) {
+		pd->link = snd_pcm_link (handle[0], handle[1]) == 0 ? 1 : 0;
+		if (pd->link) {
+			snd_pcm_unlink (handle[0]);
+		}
+	}
+
+	for (s = 0; s < 2; ++s) {
+		if (handle[s]) {
+			snd_pcm_close (handle[s]);
+		}
+	}
+
+	pd->probe_ms = (now_ns () - t0) * 1e-6;
+}
+
+static void* probe_worker (void* arg)
+{
+	ProbeQueue* q = arg;
+	unsigned int i;
+	while ((i = __atomic_fetch_add (&q->next, 1, __ATOMIC_RELAXED)) < q->n_dev) {
+		probe_device (&q->dev[i]);
+	}
+	return 0;
+}
+
+static unsigned int probe_enumerate (ProbeDevice** devs)
+{
+	int card = -1;
+	unsigned int n_dev = 0;
+	unsigned int n_alloc = 0;
+	snd_ctl_card_info_t* info;
+	snd_pcm_info_t*      pcminfo;
+
+	snd_ctl_card_info_alloca (&info);
+	snd_pcm_info_alloca (&pcminfo);
+
+	*devs = NULL;
+
+	while (snd_card_next (&card) == 0 && card >= 0) {
+		char name[32];
+		snd_ctl_t* ctl;
+		int device = -1;
+
+		snprintf (name, sizeof (name), "hw:%d", card);
+		if (snd_ctl_open (&ctl, name, 0) < 0) {
+			fprintf (stderr, "cannot open control for card %d\n", card);
+			continue;
+		}
+		if (snd_ctl_card_info (ctl, info) < 0) {
+			snd_ctl_close (ctl);
+			continue;
+		}
+
+		while (snd_ctl_pcm_next_device (ctl, &device) == 0 && device >= 0) {
+			int s;
+			ProbeDevice* pd;
+			if (n_dev == n_alloc) {
+				ProbeDevice* tmp;
+				n_alloc = n_alloc ? 2 * n_alloc : 16;
+				if (!(tmp = realloc (*devs, n_alloc * sizeof (ProbeDevice)))) {
+					fprintf (stderr, "out of memory, probing %u devices only.\n", n_dev);
+					snd_ctl_close (ctl);
+					return n_dev;
+				}
+				*devs = tmp;
+			}
+			pd = &(*devs)[n_dev];
+			memset (pd, 0, sizeof (ProbeDevice));
+			pd->card   = card;
+			pd->device = device;
+			snprintf (pd->card_id, sizeof (pd->card_id), "%s", snd_ctl_card_info_get_id (info));
+			snprintf (pd->card_name, sizeof (pd->card_name), "%s", snd_ctl_card_info_get_name (info));
+
+			for (s = 0; s < 2; ++s) {
+				snd_pcm_info_set_device (pcminfo, device);
+				snd_pcm_info_set_subdevice (pcminfo, 0);
+				snd_pcm_info_set_stream (pcminfo, (snd_pcm_stream_t) s);
+				if (snd_ctl_pcm_info (ctl, pcminfo) == 0) {
+					pd->has[s] = true;
+					if (!pd->name[0]) {
+						snprintf (pd->name, sizeof (pd->name), "%s", snd_pcm_info_get_name (pcminfo));
+					}
+				}
+			}
+			if (pd->has[0] || pd->has[1]) {
+				++n_dev;
+			}
+		}
+		snd_ctl_close (ctl);
+	}
+	return n_dev;
+}
+
+static void json_string (FILE* f, const char* s)
+{
+	fputc ('"', f);
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\') {
+			fprintf (f, "\\%c", *s);
+		} else if ((unsigned char)*s < 0x20) {
+			fprintf (f, "\\u%04x", *s);
+		} else {
+			fputc (*s, f);
+		}
+	}
+	fputc ('"', f);
+}
+
+static void probe_print_stream (FILE* f, const ProbeStream* ps)
+{
+	unsigned int i;
+	bool first;
+
+	if (ps->err < 0) {
+		fprintf (f, "{ \"error\": ");
+		json_string (f, snd_strerror (ps->err));
+		fprintf (f, " }");
+		return;
+	}
+
+	fprintf (f, "{\n        \"formats\": [");
+	for (i = 0, first = true; i <= SND_PCM_FORMAT_LAST; ++i) {
+		if (ps->formats[i]) {
+			fprintf (f, "%s\"%s\"", first ? "" : ", ", snd_pcm_format_name ((snd_pcm_format_t) i));
+			first = false;
+		}
+	}
+	fprintf (f, "],\n        \"access\": [");
+	for (i = 0, first = true; i <= SND_PCM_ACCESS_LAST; ++i) {
+		if (ps->access[i]) {
+			fprintf (f, "%s\"%s\"", first ? "" : ", ", snd_pcm_access_name ((snd_pcm_access_t) i));
+			first = false;
+		}
+	}
+	fprintf (f, "],\n        \"rates\": [");
+	for (i = 0, first = true; i < N_PROBE_RATES; ++i) {
+		if (ps->rates[i]) {
+			fprintf (f, "%s%u", first ? "" : ", ", probe_rates[i]);
+			first = false;
+		}
+	}
+	fprintf (f, "],\n");
+	fprintf (f, "        \"rate_min\": %u, \"rate_max\": %u,\n", ps->rate_min, ps->rate_max);
+	fprintf (f, "        \"channels_min\": %u, \"channels_max\": %u,\n", ps->chan_min, ps->chan_max);
+	fprintf (f, "        \"period_min\": %lu, \"period_max\": %lu,\n", ps->period_min, ps->period_max);
+	fprintf (f, "        \"periods_min\": %u, \"periods_max\": %u,\n", ps->periods_min, ps->periods_max);
+	fprintf (f, "        \"buffer_min\": %lu, \"buffer_max\": %lu,\n", ps->buffer_min, ps->buffer_max);
+	fprintf (f, "        \"sync_start\": %s, \"joint_duplex\": %s, \"batch\": %s\n      }",
+			ps->sync_start ? "true" : "false",
+			ps->joint_duplex ? "true" : "false",
+			ps->batch ? "true" : "false");
+}
+
+/* enumerate all cards and PCM devices, query the hw parameter space of
+ * each in a pool of `n_jobs` threads and print a JSON capability matrix. */
+static int probe_devices (int n_jobs)
+{
+	int j;
+	unsigned int i;
+	ProbeQueue q;
+	pthread_t* threads;
+	const uint64_t t0 = now_ns ();
+
+	memset (&q, 0, sizeof (ProbeQueue));
+	q.n_dev = probe_enumerate (&q.dev);
+
+	if (n_jobs <= 0) {
+		n_jobs = sysconf (_SC_NPROCESSORS_ONLN);
+	}
+	if (n_jobs > (int) q.n_dev) {
+		n_jobs = q.n_dev;
+	}
+
+	threads = (pthread_t*) calloc (n_jobs > 0 ? n_jobs : 1, sizeof (pthread_t));
+	for (j = 0; j < n_jobs; ++j) {
+		if (pthread_create (&threads[j], NULL, probe_worker, &q)) {
+			break;
+		}
+	}
+	if (j == 0) {
+		/* no worker threads, probe serially */
+		probe_worker (&q);
+	}
+	n_jobs = j;
+	for (j = 0; j < n_jobs; ++j) {
+		pthread_join (threads[j], NULL);
+	}
+	free (threads);
 
-			nr -= io->samples_per_period;
+	fprintf (stdout, "{\n  \"version\": \"%s\",\n", VERSION);
+	fprintf (stdout, "  \"probe_ms\": %.3f,\n", (now_ns () - t0) * 1e-6);
+	fprintf (stdout, "  \"threads\": %d,\n", n_jobs);
+	fprintf (stdout, "  \"devices\": [");
+	for (i = 0; i < q.n_dev; ++i) {
+		const ProbeDevice* pd = &q.dev[i];
+		fprintf (stdout, "%s\n    {\n", i ? "," : "");
+		fprintf (stdout, "      \"device\": \"hw:%d,%d\",\n", pd->card, pd->device);
+		fprintf (stdout, "      \"card\": %d,\n", pd->card);
+		fprintf (stdout, "      \"card_id\": ");
+		json_string (stdout, pd->card_id);
+		fprintf (stdout, ",\n      \"card_name\": ");
+		json_string (stdout, pd->card_name);
+		fprintf (stdout, ",\n      \"name\": ");
+		json_string (stdout, pd->name);
+		fprintf (stdout, ",\n      \"probe_ms\": %.3f,\n", pd->probe_ms);
+		fprintf (stdout, "      \"link\": %s,\n", pd->link < 0 ? "null" : pd->link ? "true" : "false");
+		fprintf (stdout, "      \"playback\": ");
+		if (pd->has[SND_PCM_STREAM_PLAYBACK]) {
+			probe_print_stream (stdout, &pd->stream[SND_PCM_STREAM_PLAYBACK]);
+		} else {
+			fprintf (stdout, "null");
 		}
-		if (signalled) {
-			break;
+		fprintf (stdout, ",\n      \"capture\": ");
+		if (pd->has[SND_PCM_STREAM_CAPTURE]) {
+			probe_print_stream (stdout, &pd->stream[SND_PCM_STREAM_CAPTURE]);
+		} else {
+			fprintf (stdout, "null");
 		}
+		fprintf (stdout, "\n    }");
 	}
+	fprintf (stdout, "\n  ]\n}\n");
 
-	pthread_exit (0);
+	free (q.dev);
 	return 0;
 }
 
@@ -574,19 +4567,78 @@ static void usage (int status) {
 	// TODO update option...
 	printf ("Options:\n\
       -h, --help                 display this help and exit\n\
+      -A, --add-device <dev>     additional device, may be given multiple times.\n\
+                                 Prefix with 'play=' or 'capt=' to open only\n\
+                                 one direction.\n\
       -C, --capture <hw:dev>     capture device.\n\
       -d, --device <hw:dev>      set both playback and capture devices.\n\
+          --baseline <file>      compare the results with a saved baseline,\n\
+                                 exit with status 2 on regressions, or 1 if\n\
+                                 the baseline cannot be read.\n\
+          --dither <mode>        dither 16 and 24 bit playback: 'none' (default),\n\
+                                 'tpdf' or 'shaped' (TPDF with noise-shaping).\n\
+          --dither-bench <num>   time the float to integer conversion for each\n\
+                                 format and dither mode over <num> periods and exit.\n\
+          --dsp-load <num>       convert all channels to float and back and\n\
+                                 run <num> filter passes per channel and period.\n\
+          --engine <name>        wait for the device with 'ppoll' (default) or\n\
+                                 'io_uring' (multishot poll, trace writes are\n\
+                                 submitted in the same ring).\n\
+          --hwptr-stats          sample the hw pointer at every wakeup and\n\
+                                 analyze its granularity and regularity.\n\
       -i, --inchannels <num>     number of capture channels.\n\
+          --latency              measure playback and capture delay after every\n\
+                                 cycle and compare with the latency budget.\n\
       -L, --loop <sec>           run for given number of seconds.\n\
+          --max-xruns <num>      exit with status 2 if more than <num> x-runs\n\
+                                 occurred.\n\
+          --multi-mode <mode>    service multiple devices from one event 'loop'\n\
+                                 (default) or from one thread per device ('threads').\n\
       -n, --nperiods <int>,\n\
           --play-periods <int>   playback periods per cycle.\n\
       -N, --capt-nperiods <int>\n\
                                  capture periods per cycle.\n\
       -o, --outchannels <num>    number of playback channels.\n\
       -P, --playback <hw:dev>    playback device.\n\
+          --probe                query all cards and devices and print their\n\
+                                 capabilities as JSON.\n\
+          --probe-jobs <num>     number of concurrent probe threads\n\
+                                 (default: number of CPUs).\n\
       -R, --priority <int>       real-time priority (negative) or 0\n\
       -r, --rate <int>           sample rate\n\
+          --save-baseline <file> save the results for later --baseline runs.\n\
+          --sine <hz>[,<dBFS>]   play a sine test signal instead of the capture\n\
+                                 input (default level: -20 dBFS).\n\
+          --soak <sec>           print a summary line every <sec> seconds and\n\
+                                 report the worst intervals at the end.\n\
+          --startup-bench <num>  open, start and close the device <num> times\n\
+                                 and print startup timing statistics.\n\
+          --stress <list>        run background load next to the process thread:\n\
+                                 comma separated list of 'membw', 'cache',\n\
+                                 'syscall', 'cpu' or 'all'. Each runs alone for\n\
+                                 the --loop duration after an unloaded baseline.\n\
+          --stress-cpus <list>   CPUs to run the stressors on (default: all).\n\
+          --stress-level <pct>   stressor duty cycle 1..100 (default: 100).\n\
+          --tolerance <pct>[,<ms>]\n\
+                                 allowed relative and absolute increase over\n\
+                                 the baseline (default: 10,0.05), the absolute\n\
+                                 part applies to times only.\n\
+          --trace <file>         write a binary record per process cycle to <file>.\n\
+          --trace-marker         annotate the ftrace buffer (trace_marker) with\n\
+                                 wakeup, period, x-run and recovery events.\n\
+          --trace-stop-on-xrun   with --trace-marker: turn ftrace off at the\n\
+                                 first x-run.\n\
+          --trace-export <file>  convert a binary trace to CSV on stdout and exit.\n\
+          --trace-format <fmt>   export format: 'csv' (default) or 'chrome'\n\
+                                 (JSON for chrome://tracing or Perfetto).\n\
       -V, --version              print version information and exit\n\
+          --watchdog <periods>   report process thread stalls longer than\n\
+                                 <periods> periods, with the thread's kernel\n\
+                                 stack, wchan and stream state.\n\
+          --workers <num>        split per-channel processing across <num>\n\
+                                 threads (including the process thread).\n\
+          --worker-scaling       run the test once for 1..<num> threads,\n\
+                                 each for the --loop duration.\n\
 \n");
 
 	// TODO show defaults, explain loop == 0 etc, give some examples,..
@@ -597,31 +4649,80 @@ static void usage (int status) {
 }
 
 static const struct option long_options[] = {
-	{"capture",      required_argument, 0, 'C'},
-	{"device",       required_argument, 0, 'd'},
-	{"help",         no_argument,       0, 'h'},
-	{"inchannels",   required_argument, 0, 'i'},
-	{"loop",         required_argument, 0, 'L'},
-	{"nperiods",     required_argument, 0, 'n'},
-	{"no-op",        no_argument,       0,  1 },
-	{"play-periods", required_argument, 0, 'n'},
-	{"capt-periods", required_argument, 0, 'N'},
-	{"outchannels",  required_argument, 0, 'o'},
-	{"playback",     required_argument, 0, 'P'},
-	{"period",       required_argument, 0, 'p'},
-	{"priority",     required_argument, 0, 'R'},
-	{"rate",         required_argument, 0, 'r'},
-	{"version",      no_argument,       0, 'V'}
+	{"add-device",    required_argument, 0, 'A'},
+	{"baseline",      required_argument, 0, 21 },
+	{"capture",       required_argument, 0, 'C'},
+	{"device",        required_argument, 0, 'd'},
+	{"help",          no_argument,       0, 'h'},
+	{"hwptr-stats",   no_argument,       0, 14 },
+	{"inchannels",    required_argument, 0, 'i'},
+	{"latency",       no_argument,       0, 24 },
+	{"loop",          required_argument, 0, 'L'},
+	{"max-xruns",     required_argument, 0, 23 },
+	{"multi-mode",    required_argument, 0, 15 },
+	{"nperiods",      required_argument, 0, 'n'},
+	{"no-op",         no_argument,       0,  1 },
+	{"play-periods",  required_argument, 0, 'n'},
+	{"capt-periods",  required_argument, 0, 'N'},
+	{"outchannels",   required_argument, 0, 'o'},
+	{"playback",      required_argument, 0, 'P'},
+	{"period",        required_argument, 0, 'p'},
+	{"priority",      required_argument, 0, 'R'},
+	{"probe",         no_argument,       0,  3 },
+	{"probe-jobs",    required_argument, 0,  4 },
+	{"rate",          required_argument, 0, 'r'},
+	{"save-baseline", required_argument, 0, 20 },
+	{"soak",          required_argument, 0,  8 },
+	{"startup-bench", required_argument, 0,  2 },
+	{"stress",        required_argument, 0, 16 },
+	{"stress-cpus",   required_argument, 0, 17 },
+	{"stress-level",  required_argument, 0, 18 },
+	{"tolerance",     required_argument, 0, 22 },
+	{"trace",         required_argument, 0,  9 },
+	{"trace-export",  required_argument, 0, 10 },
+	{"trace-format",  required_argument, 0, 11 },
+	{"trace-marker",  no_argument,       0, 12 },
+	{"trace-stop-on-xrun", no_argument,  0, 13 },
+	{"version",       no_argument,       0, 'V'},
+	{"watchdog",      required_argument, 0, 19 },
+	{"workers",       required_argument, 0,  5 },
+	{"worker-scaling",no_argument,       0,  6 },
+	{"dsp-load",      required_argument, 0,  7 },
+	{"dither",        required_argument, 0, 25 },
+	{"dither-bench",  required_argument, 0, 27 },
+	{"engine",        required_argument, 0, 28 },
+	{"sine",          required_argument, 0, 26 },
+	{0, 0, 0, 0}
 };
 
 int main (int argc, char** argv)
 {
 	AlsaIO io;
-	unsigned int i;
-	unsigned int n_bufs = 0;
 	memset (&io, 0, sizeof (io));
 	bool sync = true;
 	bool noop = false;
+	int startup_cycles = 0;
+	bool probe = false;
+	int probe_jobs = 0;
+	char* trace_file = NULL;
+	char* trace_export_file = NULL;
+	bool trace_chrome = false;
+	bool trace_marker = false;
+	bool trace_stop_on_xrun = false;
+	char* extra_devices[MAX_STREAMS];
+	unsigned int n_extra = 0;
+	bool multi_threads = false;
+	char* baseline_file = NULL;
+	char* save_baseline_file = NULL;
+	double tol_rel = .1;
+	double tol_abs = .05;
+	long max_xruns = -1;
+	int dither_periods = 0;
+	Watchdog watchdog;
+	memset (&watchdog, 0, sizeof (watchdog));
+	StressCtl stress;
+	memset (&stress, 0, sizeof (stress));
+	stress.level = 100;
 
 	io.samplerate = 48000;
 	io.samples_per_period = 128;
@@ -631,6 +4732,8 @@ int main (int argc, char** argv)
 	io.capt_nchan = 2;
 	io.run_for = 10; // seconds
 	io.debug = false;
+	io.marker_fd = -1;
+	io.tracing_on_fd = -1;
 
 	int rt_priority = -20;
 
@@ -640,6 +4743,7 @@ int main (int argc, char** argv)
 	int c;
 	int v;
 	while ((c = getopt_long (argc, argv,
+			   "A:" /* additional device */
 			   "C:" /* capture device */
 			   "d:" /* devices */
 			   "D"  /* */
@@ -651,6 +4755,7 @@ int main (int argc, char** argv)
 			   "o:" /* output channel count */
 			   "P:" /* playback */
 			   "p:" /* period/buffer size */
+			   "r:" /* sample rate */
 			   "R:" /* realtime priority */
 			   "S"  /* */
 			   "V", /* version */
@@ -664,6 +4769,13 @@ int main (int argc, char** argv)
 				printf ("Copyright (C) GPL 2016 Robin Gareus <robin@gareus.org>\n");
 				exit (0);
 
+			case 'A':
+				if (n_extra + 1 >= MAX_STREAMS) {
+					fprintf (stderr, "too many devices, ignored '%s'.\n", optarg);
+				} else {
+					extra_devices[n_extra++] = strdup (optarg);
+				}
+				break;
 			case 'C':
 				free (capt_device);
 				capt_device = strdup (optarg);
@@ -681,8 +4793,6 @@ int main (int argc, char** argv)
 				v = atoi (optarg);
 				if (v < 0) {
 					io.capt_nchan = 0; // auto
-				} else if (v > 64) {
-					io.capt_nchan = 64;
 				} else {
 					io.capt_nchan = v;
 				}
@@ -694,8 +4804,6 @@ int main (int argc, char** argv)
 				v = atoi (optarg);
 				if (v < 1) {
 					io.capt_periods_per_cycle = 1;
-				} else if (v > 32) {
-					io.capt_periods_per_cycle = 32;
 				} else {
 					io.capt_periods_per_cycle = v;
 				}
@@ -704,8 +4812,6 @@ int main (int argc, char** argv)
 				v = atoi (optarg);
 				if (v < 1) {
 					io.play_periods_per_cycle = 1;
-				} else if (v > 32) {
-					io.play_periods_per_cycle = 32;
 				} else {
 					io.play_periods_per_cycle = v;
 				}
@@ -714,8 +4820,6 @@ int main (int argc, char** argv)
 				v = atoi (optarg);
 				if (v < 0) {
 					io.play_nchan = 0; // auto
-				} else if (v > 64) {
-					io.play_nchan = 64;
 				} else {
 					io.play_nchan = v;
 				}
@@ -726,10 +4830,8 @@ int main (int argc, char** argv)
 				break;
 			case 'p':
 				v = atoi (optarg);
-				if (v < 8) {
-					io.samples_per_period = 8;
-				} else if (v > 8192) {
-					io.samples_per_period = 8192;
+				if (v < 1) {
+					io.samples_per_period = 1;
 				} else {
 					io.samples_per_period = v;
 				}
@@ -742,10 +4844,8 @@ int main (int argc, char** argv)
 				break;
 			case 'r':
 				v = atoi (optarg);
-				if (v < 8000) {
-					io.samplerate = 8000;
-				} else if (v > 192000) {
-					io.samplerate = 192000;
+				if (v < 1) {
+					io.samplerate = 1;
 				} else {
 					io.samplerate = v;
 				}
@@ -753,6 +4853,167 @@ int main (int argc, char** argv)
 			case 1:
 				noop = true;
 				break;
+			case 2:
+				startup_cycles = atoi (optarg);
+				if (startup_cycles < 1) {
+					startup_cycles = 1;
+				}
+				break;
+			case 3:
+				probe = true;
+				break;
+			case 4:
+				probe_jobs = atoi (optarg);
+				break;
+			case 5:
+				v = atoi (optarg);
+				if (v < 1) {
+					io.n_threads = 1;
+				} else if (v > MAX_WORKERS) {
+					io.n_threads = MAX_WORKERS;
+				} else {
+					io.n_threads = v;
+				}
+				break;
+			case 6:
+				io.scaling = true;
+				break;
+			case 7:
+				v = atoi (optarg);
+				io.dsp_load = v > 0 ? v : 0;
+				break;
+			case 8:
+				if (atof (optarg) > 0) {
+					io.soak_interval = atof (optarg) * 1e9;
+				}
+				break;
+			case 9:
+				free (trace_file);
+				trace_file = strdup (optarg);
+				break;
+			case 10:
+				free (trace_export_file);
+				trace_export_file = strdup (optarg);
+				break;
+			case 11:
+				if (!strcmp (optarg, "chrome") || !strcmp (optarg, "json")) {
+					trace_chrome = true;
+				} else if (!strcmp (optarg, "csv")) {
+					trace_chrome = false;
+				} else {
+					fprintf (stderr, "invalid trace format '%s'.\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 12:
+				trace_marker = true;
+				break;
+			case 13:
+				trace_marker = true;
+				trace_stop_on_xrun = true;
+				break;
+			case 14:
+				io.hwptr_stats = true;
+				break;
+			case 15:
+				if (!strcmp (optarg, "threads")) {
+					multi_threads = true;
+				} else if (!strcmp (optarg, "loop")) {
+					multi_threads = false;
+				} else {
+					fprintf (stderr, "invalid multi-mode '%s'.\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 16:
+				if (stress_parse (&stress, optarg)) {
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 17:
+				if (cpulist_parse (stress.cpus, &stress.n_cpus, optarg)) {
+					fprintf (stderr, "invalid CPU list '%s'.\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 18:
+				v = atoi (optarg);
+				stress.level = v < 1 ? 1 : v > 100 ? 100 : v;
+				break;
+			case 19:
+				v = atoi (optarg);
+				watchdog.threshold = v < 0 ? 0 : v;
+				break;
+			case 20:
+				free (save_baseline_file);
+				save_baseline_file = strdup (optarg);
+				break;
+			case 21:
+				free (baseline_file);
+				baseline_file = strdup (optarg);
+				break;
+			case 22:
+				{
+					char* end;
+					tol_rel = strtod (optarg, &end) / 100.;
+					if (*end == ',') {
+						tol_abs = strtod (end + 1, &end);
+					}
+					if (*end || tol_rel < 0 || tol_abs < 0) {
+						fprintf (stderr, "invalid tolerance '%s'.\n", optarg);
+						usage (EXIT_FAILURE);
+					}
+				}
+				break;
+			case 23:
+				max_xruns = atol (optarg);
+				break;
+			case 24:
+				io.latency = true;
+				break;
+			case 25:
+				if (!strcmp (optarg, "none")) {
+					io.dither = DITHER_NONE;
+				} else if (!strcmp (optarg, "tpdf")) {
+					io.dither = DITHER_TPDF;
+				} else if (!strcmp (optarg, "shaped")) {
+					io.dither = DITHER_SHAPED;
+				} else {
+					fprintf (stderr, "invalid dither mode '%s'.\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
+			case 26:
+				{
+					char* end;
+					double level = -20;
+					io.sine_freq = strtod (optarg, &end);
+					if (*end == ',') {
+						level = strtod (end + 1, &end);
+					}
+					if (*end || io.sine_freq <= 0 || level > 0) {
+						fprintf (stderr, "invalid test signal '%s'.\n", optarg);
+						usage (EXIT_FAILURE);
+					}
+					io.sine_gain = powf (10.f, level / 20.f);
+				}
+				break;
+			case 27:
+				dither_periods = atoi (optarg);
+				if (dither_periods < 1) {
+					dither_periods = 1;
+				}
+				break;
+			case 28:
+				if (!strcmp (optarg, "ppoll")) {
+					io.engine = ENGINE_PPOLL;
+				} else if (!strcmp (optarg, "io_uring") || !strcmp (optarg, "uring")) {
+					io.engine = ENGINE_URING;
+				} else {
+					fprintf (stderr, "invalid engine '%s'.\n", optarg);
+					usage (EXIT_FAILURE);
+				}
+				break;
 
 			default:
 			  usage (EXIT_FAILURE);
@@ -760,205 +5021,159 @@ int main (int argc, char** argv)
 	}
 	/* all systems go */
 
-	int err;
-	int rv = -1;
-	snd_pcm_hw_params_t* play_hwpar = NULL;
-	snd_pcm_sw_params_t* play_swpar = NULL;
-	snd_pcm_hw_params_t* capt_hwpar = NULL;
-	snd_pcm_sw_params_t* capt_swpar = NULL;
-
-	snd_pcm_format_t play_format;
-	snd_pcm_format_t capt_format;
-	snd_pcm_access_t play_access;
-	snd_pcm_access_t capt_access;
+	if ((long) io.n_threads > sysconf (_SC_NPROCESSORS_ONLN)) {
+		/* helpers and the spinning process thread need a CPU each */
+		io.n_threads = sysconf (_SC_NPROCESSORS_ONLN);
+		fprintf (stderr, "--workers limited to the number of online CPUs (%u).\n", io.n_threads);
+	}
 
-	pthread_t process_thread;
+	if ((io.dsp_load > 0 || io.sine_gain > 0 || io.dither != DITHER_NONE) && io.n_threads == 0) {
+		io.n_threads = 1;
+	}
+	io.process  = io.n_threads > 0;
+	io.n_phases = 1;
+	if (io.scaling) {
+		if (io.n_threads < 2 || io.run_for <= 0) {
+			fprintf (stderr, "--worker-scaling requires --workers > 1 and a finite --loop duration.\n");
+			exit (EXIT_FAILURE);
+		}
+		io.n_phases = io.n_threads;
+	}
 
-	if (snd_pcm_open (&io.play_handle, play_device, SND_PCM_STREAM_PLAYBACK, 0) < 0) {
-		fprintf (stderr, "cannot open playback device '%s'\n", play_device);
+	if (io.scaling && n_extra > 0 && !multi_threads) {
+		fprintf (stderr, "--worker-scaling cannot be combined with the multi-device event loop.\n");
+		exit (EXIT_FAILURE);
 	}
-	if (snd_pcm_open (&io.capt_handle, capt_device, SND_PCM_STREAM_CAPTURE, 0) < 0) {
-		fprintf (stderr, "cannot open capture device '%s'\n", capt_device);
+
+	if (io.engine == ENGINE_URING && n_extra > 0 && !multi_threads) {
+		fprintf (stderr, "--engine io_uring cannot be combined with the multi-device event loop.\n");
+		exit (EXIT_FAILURE);
 	}
-	if (!io.play_handle && !io.capt_handle) {
-		fprintf (stderr, "no capture and no playback device.\n");
-		goto out;
+
+	if (stress.n_kinds > 0) {
+		if (io.scaling || io.run_for <= 0) {
+			fprintf (stderr, "--stress requires a finite --loop duration and cannot be combined with --worker-scaling.\n");
+			exit (EXIT_FAILURE);
+		}
+		if (n_extra > 0 && !multi_threads) {
+			fprintf (stderr, "--stress cannot be combined with the multi-device event loop.\n");
+			exit (EXIT_FAILURE);
+		}
+		io.n_phases = 1 + stress.n_kinds;
 	}
 
-	if (snd_pcm_hw_params_malloc (&play_hwpar) < 0) {
-		fprintf (stderr, "cannot allocate playback hw params\n");
+	io.phase_stats = (PhaseStats*) calloc (io.n_phases, sizeof (PhaseStats));
+
+	int err;
+	int rv = -1;
+	bool regressed = false;
+	bool baseline_error = false;
+	uint64_t t_started;
+	unsigned int i;
+
+	pthread_t process_thread;
+	pthread_t stream_threads[MAX_STREAMS];
+	uint64_t  t_io_started[MAX_STREAMS];
+	AlsaIO* ios[MAX_STREAMS];
+	unsigned int n_io = 1;
+	MultiIO* multi = NULL;
+	const unsigned int req_play_nchan = io.play_nchan;
+	const unsigned int req_capt_nchan = io.capt_nchan;
+
+	ios[0] = &io;
+
+	signal (SIGINT, handle_sig);
+
+	if (trace_export_file) {
+		rv = trace_export (trace_export_file, trace_chrome);
 		goto out;
 	}
-	if (snd_pcm_sw_params_malloc (&play_swpar) < 0) {
-		fprintf (stderr, "cannot allocate playback sw params\n");
+
+	if (probe) {
+		rv = probe_devices (probe_jobs);
 		goto out;
 	}
-	if (snd_pcm_hw_params_malloc (&capt_hwpar) < 0) {
-		fprintf (stderr, "cannot allocate capture hw params\n");
+
+	if (dither_periods > 0) {
+		rv = dither_bench (&io, dither_periods);
 		goto out;
 	}
-	if (snd_pcm_sw_params_malloc (&capt_swpar) < 0) {
-		fprintf (stderr, "cannot allocate capture sw params\n");
+
+	if (startup_cycles > 0) {
+		rv = startup_bench (&io, play_device, capt_device, sync, rt_priority, startup_cycles);
 		goto out;
 	}
 
-	io.synced = false;
-	/* setup */
-	if (io.play_handle) {
-		if (set_hwpar (&io, play_hwpar, true) < 0) {
-			goto out;
-		}
-		if (set_swpar (&io, play_swpar, true) < 0) {
-			goto out;
-		}
-		io.play_npfd = snd_pcm_poll_descriptors_count (io.play_handle);
+	if (alsa_open (&io, play_device, capt_device, sync, true)) {
+		goto out;
 	}
 
-	if (io.capt_handle) {
-		if (set_hwpar (&io, capt_hwpar, false) < 0) {
-			goto out;
+	for (i = 0; i < n_extra; ++i) {
+		const char* dev = extra_devices[i];
+		const char* pdev = dev;
+		const char* cdev = dev;
+		if (!strncmp (dev, "play=", 5)) {
+			pdev = dev + 5;
+			cdev = NULL;
+		} else if (!strncmp (dev, "capt=", 5)) {
+			pdev = NULL;
+			cdev = dev + 5;
 		}
-		if (set_swpar (&io, capt_swpar, false) < 0) {
+		ios[n_io] = alsa_io_new (&io, req_play_nchan, req_capt_nchan);
+		if (alsa_open (ios[n_io++], pdev, cdev, sync, true)) {
 			goto out;
 		}
-		io.capt_npfd = snd_pcm_poll_descriptors_count (io.capt_handle);
-
-		if (io.play_handle && sync) {
-			io.synced = ! snd_pcm_link (io.play_handle, io.capt_handle);
-		}
 	}
 
-	/* verify settings */
-	if (io.play_handle) {
-		int dir;
-		unsigned int val;
-		snd_pcm_uframes_t fc;
-		if (snd_pcm_hw_params_get_rate (play_hwpar, &val, &dir) || (val != io.samplerate) || dir) {
-			fprintf (stderr, "cannot get requested sample rate for playback.\n");
-			goto out;
-		}
-		if (snd_pcm_hw_params_get_period_size (play_hwpar, &fc, &dir) || (fc != io.samples_per_period) || dir) {
-			fprintf (stderr, "cannot get requested period size for playback.\n");
-			goto out;
-		}
-		if (snd_pcm_hw_params_get_periods (play_hwpar, &val, &dir) || (val != io.play_periods_per_cycle) || dir)
-		{
-			fprintf (stderr, "cannot get requested number of periods for playback.\n");
-			goto out;
-		}
+	if (io.process && !noop && pool_start (&io, rt_priority)) {
+		goto out;
 	}
 
-	if (io.capt_handle) {
-		int dir;
-		unsigned int val;
-		snd_pcm_uframes_t fc;
-		if (snd_pcm_hw_params_get_rate (capt_hwpar, &val, &dir) || (val != io.samplerate) || dir) {
-			fprintf (stderr, "cannot get requested sample rate for capture.\n");
-			goto out;
-		}
-		if (snd_pcm_hw_params_get_period_size (capt_hwpar, &fc, &dir) || (fc != io.samples_per_period) || dir) {
-			fprintf (stderr, "cannot get requested period size for capture.\n");
-			goto out;
-		}
-		if (snd_pcm_hw_params_get_periods (capt_hwpar, &val, &dir) || (val != io.capt_periods_per_cycle) || dir)
-		{
-			fprintf (stderr, "cannot get requested number of periods for capture.\n");
+	for (i = 0; io.engine == ENGINE_URING && !noop && i < n_io; ++i) {
+		if (uring_open (ios[i])) {
 			goto out;
 		}
 	}
 
-	if (io.play_handle) {
-		snd_pcm_hw_params_get_format (play_hwpar, &play_format);
-		snd_pcm_hw_params_get_access (play_hwpar, &play_access);
-
-		switch (play_format) {
-			case SND_PCM_FORMAT_FLOAT_LE:
-			case SND_PCM_FORMAT_S32_LE:
-			case SND_PCM_FORMAT_S32_BE:
-			case SND_PCM_FORMAT_S24_LE:
-			case SND_PCM_FORMAT_S24_BE:
-				io.play_bytes_per_sample = 4;
-				break;
-			case SND_PCM_FORMAT_S24_3LE:
-			case SND_PCM_FORMAT_S24_3BE:
-				io.play_bytes_per_sample = 3;
-				break;
-			case SND_PCM_FORMAT_S16_LE:
-			case SND_PCM_FORMAT_S16_BE:
-				io.play_bytes_per_sample = 2;
-				break;
-			default:
-				fprintf (stderr, "Cannot handle playback sample format.\n");
-				goto out;
-		}
+	if (trace_file && !noop && trace_open (&io, trace_file)) {
+		goto out;
 	}
 
-	if (io.capt_handle) {
-		snd_pcm_hw_params_get_format (capt_hwpar, &capt_format);
-		snd_pcm_hw_params_get_access (capt_hwpar, &capt_access);
-
-		switch (capt_format) {
-			case SND_PCM_FORMAT_FLOAT_LE:
-			case SND_PCM_FORMAT_S32_LE:
-			case SND_PCM_FORMAT_S32_BE:
-			case SND_PCM_FORMAT_S24_LE:
-			case SND_PCM_FORMAT_S24_BE:
-				io.capt_bytes_per_sample = 4;
-				break;
-			case SND_PCM_FORMAT_S24_3LE:
-			case SND_PCM_FORMAT_S24_3BE:
-				io.capt_bytes_per_sample = 3;
-				break;
-			case SND_PCM_FORMAT_S16_LE:
-			case SND_PCM_FORMAT_S16_BE:
-				io.capt_bytes_per_sample = 2;
-				break;
-			default:
-				fprintf (stderr, "Cannot handle capture sample format.\n");
-				goto out;
-		}
+	if (trace_marker && marker_open (&io, trace_stop_on_xrun)) {
+		goto out;
 	}
 
-	fprintf (stdout, "playback: ");
-	if (io.play_handle) {
-		fprintf (stdout, "\n");
-		fprintf (stdout, "  channels   : %d\n",  io.play_nchan);
-		fprintf (stdout, "  samplerate : %d\n",  io.samplerate);
-		fprintf (stdout, "  buffersize : %ld\n", io.samples_per_period);
-		fprintf (stdout, "  periods    : %d\n",  io.play_periods_per_cycle);
-		fprintf (stdout, "  format     : %s\n",  snd_pcm_format_name (play_format));
-	} else {
-		fprintf (stdout, " not enabled\n");
-		io.play_nchan = 0;
-	}
-	fprintf (stdout, "capture:  ");
-	if (io.capt_handle) {
-		fprintf (stdout, "\n");
-		fprintf (stdout, "  channels   : %d\n",  io.capt_nchan);
-		fprintf (stdout, "  samplerate : %d\n",  io.samplerate);
-		fprintf (stdout, "  buffersize : %ld\n", io.samples_per_period);
-		fprintf (stdout, "  periods    : %d\n",  io.capt_periods_per_cycle);
-		fprintf (stdout, "  format     : %s\n",  snd_pcm_format_name (capt_format));
-		if (io.play_handle) {
-			fprintf (stdout, "%s\n", io.synced ? "synced" : "not synced");
-		}
-	} else {
-		fprintf (stdout, " not enabled\n");
-		io.capt_nchan = 0;
+	if (stress.n_kinds > 0 && !noop && stress_start (&stress, &io)) {
+		goto out;
 	}
 
+	t_started = now_ns ();
 	if (pcm_start (&io)) {
 		goto out;
 	}
+	io.startup.start = now_ns () - t_started;
+	t_started += io.startup.start;
 
-	n_bufs = io.play_nchan > io.capt_nchan ? io.play_nchan : io.capt_nchan;
-	io.testbuffers = (float**) malloc (n_bufs * sizeof (float*));
+	t_io_started[0] = t_started;
+	for (i = 1; i < n_io; ++i) {
+		const uint64_t t0 = now_ns ();
+		if (pcm_start (ios[i])) {
+			while (i-- > 0) {
+				pcm_stop (ios[i]);
+			}
+			goto out;
+		}
+		t_io_started[i] = now_ns ();
+		ios[i]->startup.start = t_io_started[i] - t0;
+	}
 
-	for (i = 0; i < n_bufs; ++i) {
-		io.testbuffers[i] = (float*) malloc (io.samples_per_period * sizeof (float));
+	for (i = 0; i < n_io; ++i) {
+		print_latency_budget (ios[i]);
 	}
 
-	signal (SIGINT, handle_sig);
+	if (watchdog.threshold > 0 && !noop) {
+		watchdog_start (&watchdog, ios, n_io, rt_priority);
+	}
 
 	if (noop) {
 		// only open the device, don't do anything
@@ -969,12 +5184,82 @@ int main (int argc, char** argv)
 		} else {
 			sleep (io.run_for);
 		}
-	} else {
-		if (rt_priority < 0) {
-			err = realtime_pthread_create (SCHED_FIFO, rt_priority, 100000, &process_thread, run_thread, &io);
+	} else if (n_io > 1) {
+		unsigned int n_threads = 0;
+		if (multi_threads) {
+			for (n_threads = 0; n_threads < n_io; ++n_threads) {
+				if (start_process_thread (ios[n_threads], rt_priority, &stream_threads[n_threads])) {
+					fprintf (stderr, "cannot create realtime process thread.\n");
+					break;
+				}
+			}
 		} else {
-			err = pthread_create (&process_thread, NULL, run_thread, &io);
+			multi = (MultiIO*) calloc (1, sizeof (MultiIO));
+			multi->run_for = io.run_for;
+			for (i = 0; i < n_io; ++i) {
+				multi->streams[i].io = ios[i];
+			}
+			multi->n_streams = n_io;
+			if (start_rt_thread (rt_priority, &stream_threads[0], run_multi_thread, multi)) {
+				fprintf (stderr, "cannot create realtime process thread.\n");
+			} else {
+				n_threads = 1;
+			}
+		}
+
+		if (n_threads > 0 && io.soak_interval > 0) {
+			soak_monitor (&io);
+		}
+		for (i = 0; i < n_threads; ++i) {
+			pthread_join (stream_threads[i], NULL);
+		}
+		watchdog_stop (&watchdog);
+		stress_stop (&stress);
+		bool engine_failed = false;
+		for (i = 0; i < n_io; ++i) {
+			engine_failed |= ios[i]->uring && ios[i]->uring->failed;
+		}
+		if (n_threads == 0 || (multi_threads && n_threads < n_io) || engine_failed) {
+			for (i = 0; i < n_io; ++i) {
+				pcm_stop (ios[i]);
+			}
+			if (engine_failed) {
+				rv = EXIT_FAILURE;
+			}
+			goto out;
+		}
+
+		print_multi_stats (ios, n_io, multi);
+		for (i = 0; i < n_io; ++i) {
+			AlsaIO* sio = ios[i];
+			if (sio->t_first_period) {
+				sio->startup.first_period = sio->t_first_period - t_io_started[i];
+			}
+			fprintf (stdout, "%s:\n", sio->name);
+			print_startup (sio);
+			print_run_hists (sio);
+			if (sio->hwptr_stats) {
+				print_hwptr_stats (sio);
+			}
+		}
+		for (i = 0; multi_threads && i < n_io; ++i) {
+			print_engine_stats (ios[i]);
+		}
+		for (i = 0; io.latency && i < n_io; ++i) {
+			print_latency_stats (ios[i]);
+		}
+		if (watchdog.ios) {
+			print_watchdog_stats (&watchdog);
+		}
+		if (io.process) {
+			print_process_stats (&io);
+		}
+		for (i = 0; stress.n_threads > 0 && i < n_io; ++i) {
+			fprintf (stdout, "%s:\n", ios[i]->name);
+			print_stress_stats (ios[i], &stress);
 		}
+	} else {
+		err = start_process_thread (&io, rt_priority, &process_thread);
 
 		if (err) {
 			fprintf (stderr, "cannot create realtime process thread.\n");
@@ -982,35 +5267,103 @@ int main (int argc, char** argv)
 			goto out;
 		} else {
 			void *status;
+			if (io.soak_interval > 0) {
+				soak_monitor (&io);
+			}
 			pthread_join (process_thread, &status);
 		}
+		watchdog_stop (&watchdog);
+		stress_stop (&stress);
+		if (io.uring && io.uring->failed) {
+			pcm_stop (&io);
+			rv = EXIT_FAILURE;
+			goto out;
+		}
+
+		if (io.t_first_period) {
+			io.startup.first_period = io.t_first_period - t_started;
+		}
+		print_startup (&io);
+		print_run_stats (&io);
+		print_engine_stats (&io);
+		if (io.latency) {
+			print_latency_stats (&io);
+		}
+		if (watchdog.ios) {
+			print_watchdog_stats (&watchdog);
+		}
+		if (io.hwptr_stats) {
+			print_hwptr_stats (&io);
+		}
+		if (io.process) {
+			print_process_stats (&io);
+		}
+		if (stress.n_threads > 0) {
+			print_stress_stats (&io, &stress);
+		}
+	}
+
+	if (!noop) {
+		uint64_t xruns = 0;
+		for (i = 0; i < n_io; ++i) {
+			xruns += ios[i]->stats.xruns;
+		}
+		if (max_xruns >= 0 && xruns > (uint64_t) max_xruns) {
+			fprintf (stdout, "x-runs: %" PRIu64 " > %ld: FAIL\n", xruns, max_xruns);
+			regressed = true;
+		}
+		if (baseline_file) {
+			const int n_fail = baseline_compare (&io, baseline_file, tol_rel, tol_abs);
+			if (n_fail < 0) {
+				/* not a regression, the gate itself failed */
+				baseline_error = true;
+			} else if (n_fail > 0) {
+				regressed = true;
+			}
+		}
+		if (save_baseline_file && baseline_save (&io, save_baseline_file)) {
+			goto out;
+		}
 	}
 
+	for (i = 1; i < n_io; ++i) {
+		pcm_stop (ios[i]);
+	}
 	if (pcm_stop (&io)) {
 		goto out;
 	}
 
-	rv = 0;
+	rv = baseline_error ? EXIT_FAILURE : regressed ? 2 : 0;
 
 out:
+	for (i = 1; i < n_io; ++i) {
+		uring_close (ios[i]);
+		alsa_close (ios[i]);
+		free (ios[i]->phase_stats);
+		free (ios[i]);
+	}
+	free (io.phase_stats);
+	for (i = 0; i < n_extra; ++i) {
+		free (extra_devices[i]);
+	}
+	free (multi);
+
 	free (play_device);
 	free (capt_device);
+	free (trace_file);
+	free (trace_export_file);
+	free (baseline_file);
+	free (save_baseline_file);
 
-	if (io.play_handle) {
-		snd_pcm_close (io.play_handle);
-	}
-	if (io.capt_handle) {
-		snd_pcm_close (io.capt_handle);
+	watchdog_stop (&watchdog);
+	stress_free (&stress);
+	uring_close (&io);
+	trace_close (&io);
+	marker_close (&io);
+	if (io.pool.workers) {
+		pool_stop (&io);
 	}
-	for (i = 0; i < n_bufs; i++) {
-		free (io.testbuffers[i]);
-	}
-	free (io.testbuffers);
-
-	snd_pcm_sw_params_free (capt_swpar);
-	snd_pcm_hw_params_free (capt_hwpar);
-	snd_pcm_sw_params_free (play_swpar);
-	snd_pcm_hw_params_free (play_hwpar);
+	alsa_close (&io);
 
 	return rv;
 }